@@ -0,0 +1,115 @@
+#pragma once
+
+#include <string>
+#include <vector>
+#include <future>
+#include <cstring>
+#include <fcntl.h>
+#include <unistd.h>
+
+#include "util.hpp"
+
+DECLARE_uint64(write_blocksize);
+DECLARE_bool(async_write);
+
+/*
+ * Collects small writes into large blocks, each written out with a single
+ * pwrite. With async set, a full block is flushed on the thread pool while
+ * the caller fills the second block; at most one flush is in flight.
+ */
+class block_writer
+{
+  private:
+    int fd;
+    size_t offset, used; // file offset of the current block and its fill
+    bool async;
+    std::vector<char> block, flushing;
+    std::future<void> pending;
+
+    void wait()
+    {
+        if (pending.valid())
+            pending.get();
+    }
+
+    void flush_block()
+    {
+        wait();
+        if (used == 0)
+            return;
+        block.swap(flushing);
+        int f = fd;
+        char *buf = &flushing[0];
+        size_t n = used, off = offset;
+        offset += used;
+        used = 0;
+        if (async)
+            pending = pool.postWork<void>(
+                [f, buf, n, off]() { pwritea(f, buf, n, off); });
+        else
+            pwritea(f, buf, n, off);
+    }
+
+  public:
+    block_writer(size_t block_size = FLAGS_write_blocksize * 1024 * 1024,
+                 bool async = FLAGS_async_write)
+        : fd(-1), offset(0), used(0), async(async),
+          block(std::max((size_t)1, block_size)),
+          flushing(std::max((size_t)1, block_size))
+    {
+    }
+
+    block_writer(const std::string &filename,
+                 size_t block_size = FLAGS_write_blocksize * 1024 * 1024,
+                 bool async = FLAGS_async_write)
+        : block_writer(block_size, async)
+    {
+        open(filename);
+    }
+
+    ~block_writer()
+    {
+        if (fd != -1)
+            close();
+    }
+
+    void open(const std::string &filename)
+    {
+        CHECK_EQ(fd, -1) << "writer is already open";
+        fd = ::open(filename.c_str(), O_WRONLY | O_CREAT | O_TRUNC,
+                    S_IRUSR | S_IWUSR | S_IRGRP | S_IROTH);
+        PCHECK(fd != -1) << "Error opening `" << filename << "' for write";
+        offset = used = 0;
+    }
+
+    void write(const char *s, size_t n)
+    {
+        while (n > 0) {
+            size_t len = std::min(n, block.size() - used);
+            memcpy(&block[used], s, len);
+            used += len;
+            s += len;
+            n -= len;
+            if (used == block.size())
+                flush_block();
+        }
+    }
+
+    /* Overwrites already written bytes, e.g., a header */
+    void write_at(size_t pos, const char *s, size_t n)
+    {
+        flush_block();
+        wait();
+        pwritea(fd, (char *)s, n, pos);
+    }
+
+    size_t tell() const { return offset + used; }
+
+    void close()
+    {
+        flush_block();
+        wait();
+        PCHECK(::close(fd) != -1) << "Error closing file";
+        fd = -1;
+    }
+};
@@ -0,0 +1,117 @@
+#pragma once
+
+#include <vector>
+
+#include "util.hpp"
+#include "dense_bitset.hpp"
+
+/*
+ * Bucket queue with the interface of MinHeap, for small integer values such
+ * as the remaining degrees of the expansion: every value has a doubly linked
+ * list of its keys, so decrease_key and remove are O(1), and get_min moves a
+ * cursor up over empty buckets, which only insert and decrease_key can take
+ * back down. Among the keys with the minimum value, the last one to get there
+ * comes first.
+ */
+template <typename ValueType, typename KeyType>
+class BucketQueue
+{
+  private:
+    static const KeyType NIL = (KeyType)-1;
+
+    size_t n;
+    ValueType min_value;
+    std::vector<KeyType> buckets; // first key of every value
+    std::vector<KeyType> next, prev;
+    std::vector<ValueType> values;
+    dense_bitset in_queue;
+
+    void link(ValueType value, KeyType key)
+    {
+        if (value >= buckets.size())
+            buckets.resize(std::max((size_t)value + 1, 2 * buckets.size()),
+                           NIL);
+        values[key] = value;
+        prev[key] = NIL;
+        next[key] = buckets[value];
+        if (next[key] != NIL)
+            prev[next[key]] = key;
+        buckets[value] = key;
+        if (value < min_value)
+            min_value = value;
+    }
+
+    void unlink(KeyType key)
+    {
+        if (prev[key] != NIL)
+            next[prev[key]] = next[key];
+        else
+            buckets[values[key]] = next[key];
+        if (next[key] != NIL)
+            prev[next[key]] = prev[key];
+    }
+
+  public:
+    BucketQueue() : n(0), min_value(0) { }
+
+    void insert(ValueType value, KeyType key)
+    {
+        if (n++ == 0)
+            min_value = value;
+        in_queue.set_bit_unsync(key);
+        link(value, key);
+    }
+
+    bool contains(KeyType key) { return in_queue.get(key); }
+
+    void decrease_key(KeyType key, ValueType d = 1)
+    {
+        if (d == 0) return;
+        CHECK(contains(key)) << "key not found";
+
+        CHECK_GE(values[key], d) << "value cannot be negative";
+        unlink(key);
+        link(values[key] - d, key);
+    }
+
+    bool remove(KeyType key)
+    {
+        if (!contains(key))
+            return false;
+        unlink(key);
+        in_queue.clear_bit_unsync(key);
+        n--;
+        return true;
+    }
+
+    bool get_min(ValueType& value, KeyType& key)
+    {
+        if (n == 0)
+            return false;
+        while (buckets[min_value] == NIL)
+            min_value++;
+        value = min_value;
+        key = buckets[min_value];
+        return true;
+    }
+
+    void reserve(KeyType nelements)
+    {
+        next.resize(nelements);
+        prev.resize(nelements);
+        values.resize(nelements);
+        in_queue.resize(nelements);
+        clear();
+    }
+
+    void clear()
+    {
+        n = 0;
+        min_value = 0;
+        std::fill(buckets.begin(), buckets.end(), NIL);
+        in_queue.clear();
+    }
+};
+
+template <typename ValueType, typename KeyType>
+const KeyType BucketQueue<ValueType, KeyType>::NIL;
@@ -1,120 +1,413 @@
 #include <string.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+#include <unistd.h>
+#include <omp.h>
 
 #include "conversions.hpp"
+#include "relabel.hpp"
 
-// Removes \n from the end of line
-void FIXLINE(char *s)
+static inline bool is_delim(char c) { return c == '\t' || c == ',' || c == ' '; }
+
+// Parses an integer token the way atoi does (optional sign, leading digits)
+// and returns the position right after the token
+template <typename vid_t>
+static inline const char *scan_vid(const char *p, const char *end, vid_t &v)
 {
-    int len = (int)strlen(s) - 1;
-    if (s[len] == '\n')
-        s[len] = 0;
+    bool neg = false;
+    if (p < end && (*p == '-' || *p == '+'))
+        neg = *p++ == '-';
+    vid_t x = 0;
+    for (; p < end && *p >= '0' && *p <= '9'; p++)
+        x = x * 10 + (*p - '0');
+    v = neg ? -x : x;
+    while (p < end && !is_delim(*p))
+        p++;
+    return p;
 }
 
-void convert_edgelist(std::string inputfile, Converter *converter)
+// Parses the complete lines in [begin, end) and returns the number of lines
+template <typename vid_t>
+static size_t parse_edgelist_range(const char *begin, const char *end,
+                                   std::vector<basic_edge_t<vid_t>> &edges)
 {
-    FILE *inf = fopen(inputfile.c_str(), "r");
-    size_t bytesread = 0;
+    typedef basic_edge_t<vid_t> edge_t;
+
     size_t linenum = 0;
-    if (inf == NULL) {
+    for (const char *s = begin; s < end;) {
+        const char *eol = (const char *)memchr(s, '\n', end - s);
+        if (eol == NULL)
+            eol = end;
+        linenum++;
+        const char *line = s, *t = s;
+        s = eol + 1;
+        if (*t == '#' || *t == '%')
+            continue; // Comment
+
+        while (t < eol && is_delim(*t))
+            t++;
+        if (t == eol || (*t == '\r' && t + 1 == eol))
+            continue; // Empty line
+        vid_t from, to;
+        t = scan_vid(t, eol, from);
+        while (t < eol && is_delim(*t))
+            t++;
+        if (t == eol)
+            LOG(FATAL) << "Input file is not in right format. "
+                       << "Expecting \"<from>\t<to>\". "
+                       << "Current line: \"" << std::string(line, eol)
+                       << "\"\n";
+        scan_vid(t, eol, to);
+
+        if (from != to)
+            edges.push_back(edge_t(from, to));
+    }
+    return linenum;
+}
+
+template <typename vid_t>
+void convert_edgelist(std::string inputfile, Converter<vid_t> *converter)
+{
+    typedef basic_edge_t<vid_t> edge_t;
+
+    int fd = open(inputfile.c_str(), O_RDONLY);
+    if (fd == -1) {
         LOG(FATAL) << "Could not load:" << inputfile
                    << ", error: " << strerror(errno) << std::endl;
     }
+    struct stat fileInfo = {0};
+    PCHECK(fstat(fd, &fileInfo) != -1) << "Error getting the file size";
+    size_t filesize = fileInfo.st_size;
 
     LOG(INFO) << "Reading in edge list format!" << std::endl;
-    char s[1024];
-    while (fgets(s, 1024, inf) != NULL) {
-        linenum++;
-        if (linenum % 10000000 == 0) {
-            LOG(INFO) << "Read " << linenum << " lines, "
-                      << bytesread / 1024 / 1024. << " MB" << std::endl;
+    if (filesize == 0) {
+        close(fd);
+        return;
+    }
+    char *map = (char *)mmap(0, filesize, PROT_READ, MAP_PRIVATE, fd, 0);
+    if (map == MAP_FAILED) {
+        close(fd);
+        PLOG(FATAL) << "error mapping the file";
+    }
+    madvise(map, filesize, MADV_SEQUENTIAL);
+
+    // The file is parsed window by window so that the parsed edges stay
+    // within the memory budget; each window is cut at a newline and split
+    // into one newline-aligned range per thread.
+    int nthreads = omp_get_max_threads();
+    size_t window = std::max((size_t)1 << 20, FLAGS_memsize * 1024 * 1024 / 4);
+    std::vector<std::vector<edge_t>> edges(nthreads);
+    std::vector<size_t> lines(nthreads);
+    std::vector<const char *> bounds(nthreads + 1);
+    size_t linenum = 0;
+    const char *end = map + filesize;
+    for (const char *begin = map; begin < end;) {
+        const char *wend = end;
+        if ((size_t)(end - begin) > window) {
+            wend = (const char *)memchr(begin + window, '\n',
+                                        end - begin - window);
+            wend = wend ? wend + 1 : end;
         }
-        FIXLINE(s);
-        bytesread += strlen(s);
-        if (s[0] == '#')
-            continue; // Comment
-        if (s[0] == '%')
-            continue; // Comment
 
-        char delims[] = "\t, ";
-        char *t;
-        t = strtok(s, delims);
-        if (t == NULL) {
-            LOG(FATAL) << "Input file is not in right format. "
-                       << "Expecting \"<from>\t<to>\". "
-                       << "Current line: \"" << s << "\"\n";
+        bounds[0] = begin;
+        for (int i = 1; i < nthreads; i++) {
+            const char *b = begin + (wend - begin) / nthreads * i;
+            b = std::max(b, bounds[i - 1]);
+            const char *nl = (const char *)memchr(b, '\n', wend - b);
+            bounds[i] = nl ? nl + 1 : wend;
         }
-        vid_t from = atoi(t);
-        t = strtok(NULL, delims);
-        if (t == NULL) {
-            LOG(FATAL) << "Input file is not in right format. "
-                       << "Expecting \"<from>\t<to>\". "
-                       << "Current line: \"" << s << "\"\n";
+        bounds[nthreads] = wend;
+
+#pragma omp parallel for schedule(static, 1)
+        for (int i = 0; i < nthreads; i++) {
+            edges[i].clear();
+            lines[i] = parse_edgelist_range(bounds[i], bounds[i + 1], edges[i]);
         }
-        vid_t to = atoi(t);
 
-        if (from != to) {
-            converter->add_edge(from, to);
+        rep (i, nthreads) {
+            converter->add_edges(edges[i].data(), edges[i].size());
+            linenum += lines[i];
         }
+        begin = wend;
+        LOG(INFO) << "Read " << linenum << " lines, "
+                  << (begin - map) / 1024 / 1024. << " MB" << std::endl;
     }
-    fclose(inf);
+
+    munmap(map, filesize);
+    close(fd);
 }
 
-void convert_adjlist(std::string inputfile, Converter *converter)
+static inline bool is_adj_delim(char c)
 {
-    FILE *inf = fopen(inputfile.c_str(), "r");
-    if (inf == NULL) {
+    return c == ' ' || c == '\t' || c == '\r' || c == '\n';
+}
+
+static inline bool is_comment(char c) { return c == '#' || c == '%'; }
+
+/* Result of scanning one piece of an adjacency list chunk */
+template <typename vid_t>
+struct adjpiece_t {
+    // tokens before the first newline; they continue the line that is open
+    // when the piece starts
+    std::vector<vid_t> head;
+    bool first_comment;
+    bool has_newline;
+    // edges and number of the complete lines, and the first bad line
+    std::vector<basic_edge_t<vid_t>> edges;
+    size_t lines, bad_line;
+    vid_t bad_from, bad_num, bad_count;
+    // tokens after the last newline, which open a new line
+    std::vector<vid_t> tail;
+    bool tail_started, tail_comment;
+};
+
+template <typename vid_t>
+static const char *scan_adj_tokens(const char *p, const char *end,
+                                   std::vector<vid_t> &tokens)
+{
+    while (p < end && *p != '\n') {
+        if (is_adj_delim(*p)) {
+            p++;
+            continue;
+        }
+        vid_t v = 0;
+        for (; p < end && *p >= '0' && *p <= '9'; p++)
+            v = v * 10 + (*p - '0');
+        while (p < end && !is_adj_delim(*p))
+            p++;
+        tokens.push_back(v);
+    }
+    return p;
+}
+
+template <typename vid_t>
+static void parse_adjlist_piece(const char *begin, const char *end,
+                                adjpiece_t<vid_t> &piece)
+{
+    typedef basic_edge_t<vid_t> edge_t;
+
+    piece.head.clear();
+    piece.edges.clear();
+    piece.tail.clear();
+    piece.lines = 0;
+    piece.bad_line = (size_t)-1;
+    piece.first_comment = begin < end && is_comment(*begin);
+
+    const char *p = scan_adj_tokens(begin, end, piece.head);
+    piece.has_newline = p < end;
+    if (!piece.has_newline)
+        return;
+    const char *last = end - 1;
+    while (*last != '\n')
+        last--;
+
+    std::vector<vid_t> &tokens = piece.tail;
+    for (p++; p <= last; p++) {
+        const char *line = p;
+        tokens.clear();
+        p = scan_adj_tokens(p, last + 1, tokens);
+        if (is_comment(*line) || tokens.size() < 2) {
+            piece.lines++;
+            continue;
+        }
+        vid_t from = tokens[0];
+        for (size_t i = 2; i < tokens.size(); i++)
+            if (tokens[i] != from)
+                piece.edges.push_back(edge_t(from, tokens[i]));
+        if (tokens[1] != tokens.size() - 2 && piece.bad_line == (size_t)-1) {
+            piece.bad_line = piece.lines;
+            piece.bad_from = from;
+            piece.bad_num = tokens[1];
+            piece.bad_count = tokens.size() - 2;
+        }
+        piece.lines++;
+    }
+
+    tokens.clear();
+    piece.tail_started = last + 1 < end;
+    piece.tail_comment = piece.tail_started && is_comment(last[1]);
+    scan_adj_tokens(last + 1, end, tokens);
+}
+
+/* The line that is open between pieces, which may span many chunks */
+template <typename vid_t>
+struct adjline_t {
+    typedef basic_edge_t<vid_t> edge_t;
+
+    bool started, comment;
+    size_t ntokens;
+    vid_t from, num;
+
+    void reset()
+    {
+        started = comment = false;
+        ntokens = 0;
+        from = num = 0;
+    }
+
+    void feed(const std::vector<vid_t> &tokens, std::vector<edge_t> &edges)
+    {
+        if (comment)
+            return;
+        for (vid_t t : tokens) {
+            if (ntokens == 0)
+                from = t;
+            else if (ntokens == 1)
+                num = t;
+            else if (t != from)
+                edges.push_back(edge_t(from, t));
+            ntokens++;
+        }
+    }
+
+    void check(size_t linenum)
+    {
+        if (!comment && ntokens >= 2 && num != ntokens - 2)
+            LOG(FATAL) << "Mismatch when reading adjacency list: " << num
+                       << " != " << ntokens - 2 << " of vertex " << from
+                       << " on line: " << linenum << std::endl;
+    }
+};
+
+template <typename vid_t>
+void convert_adjlist(std::string inputfile, Converter<vid_t> *converter)
+{
+    typedef basic_edge_t<vid_t> edge_t;
+
+    int fd = open(inputfile.c_str(), O_RDONLY);
+    if (fd == -1) {
         LOG(FATAL) << "Could not load:" << inputfile
                    << " error: " << strerror(errno) << std::endl;
     }
     LOG(INFO) << "Reading in adjacency list format!" << std::endl;
+    posix_fadvise(fd, 0, 0, POSIX_FADV_SEQUENTIAL);
 
-    int maxlen = 1000000000;
-    char *s = (char *)malloc(maxlen);
-
-    size_t bytesread = 0;
-
-    char delims[] = " \t";
-    size_t linenum = 0;
-    size_t lastlog = 0;
+    // A chunk is cut after its last delimiter and the rest is carried over
+    // to the next chunk. The chunk is split into one piece per thread at
+    // delimiters, so lines may cross both pieces and chunks; the pieces are
+    // scanned in parallel and stitched together in order.
+    int nthreads = omp_get_max_threads();
+    size_t bufsize =
+        std::max((size_t)1 << 20, FLAGS_memsize * 1024 * 1024 / 8);
+    std::vector<char> buf(bufsize);
+    std::vector<adjpiece_t<vid_t>> pieces(nthreads);
+    std::vector<const char *> bounds(nthreads + 1);
+    std::vector<edge_t> edges;
+    adjline_t<vid_t> line;
+    line.reset();
+    size_t linenum = 0, bytesread = 0, carry = 0;
+    bool eof = false;
+    while (!eof) {
+        size_t len = carry;
+        while (len < bufsize) {
+            ssize_t a = read(fd, &buf[len], bufsize - len);
+            PCHECK(a != ssize_t(-1)) << "Could not read " << inputfile;
+            if (a == 0) {
+                eof = true;
+                break;
+            }
+            len += a;
+        }
+        size_t cut = len;
+        if (!eof) {
+            while (cut > 0 && !is_adj_delim(buf[cut - 1]))
+                cut--;
+            // only a comment can run this long without a delimiter
+            if (cut == 0)
+                cut = len;
+        }
 
-    while (fgets(s, maxlen, inf) != NULL) {
-        linenum++;
-        if (bytesread - lastlog >= 500000000) {
-            LOG(INFO) << "Read " << linenum << " lines, "
-                      << bytesread / 1024 / 1024. << " MB" << std::endl;
-            lastlog = bytesread;
+        const char *begin = &buf[0], *end = begin + cut;
+        bounds[0] = begin;
+        for (int i = 1; i < nthreads; i++) {
+            const char *b = std::max(begin + cut / nthreads * i, bounds[i - 1]);
+            while (b < end && !is_adj_delim(*b))
+                b++;
+            bounds[i] = b < end ? b + 1 : end;
         }
-        FIXLINE(s);
-        bytesread += strlen(s);
+        bounds[nthreads] = end;
 
-        if (s[0] == '#')
-            continue; // Comment
-        if (s[0] == '%')
-            continue; // Comment
-        char *t = strtok(s, delims);
-        vid_t from = atoi(t);
-        t = strtok(NULL, delims);
-        if (t != NULL) {
-            vid_t num = atoi(t);
-            vid_t i = 0;
-            while ((t = strtok(NULL, delims)) != NULL) {
-                vid_t to = atoi(t);
-                if (from != to) {
-                    converter->add_edge(from, to);
-                }
-                i++;
+#pragma omp parallel for schedule(static, 1)
+        for (int i = 0; i < nthreads; i++)
+            parse_adjlist_piece(bounds[i], bounds[i + 1], pieces[i]);
+
+        rep (i, nthreads) {
+            adjpiece_t<vid_t> &piece = pieces[i];
+            if (bounds[i] == bounds[i + 1])
+                continue;
+            if (!line.started) {
+                line.started = true;
+                line.comment = piece.first_comment;
             }
-            if (num != i)
-                LOG(FATAL) << "Mismatch when reading adjacency list: " << num
-                           << " != " << i << " s: " << std::string(s)
-                           << " on line: " << linenum << std::endl;
+            edges.clear();
+            line.feed(piece.head, edges);
+            converter->add_edges(edges.data(), edges.size());
+            if (!piece.has_newline)
+                continue;
+
+            line.check(++linenum);
+            if (piece.bad_line != (size_t)-1)
+                LOG(FATAL) << "Mismatch when reading adjacency list: "
+                           << piece.bad_num << " != " << piece.bad_count
+                           << " of vertex " << piece.bad_from
+                           << " on line: " << linenum + 1 + piece.bad_line
+                           << std::endl;
+            converter->add_edges(piece.edges.data(), piece.edges.size());
+            linenum += piece.lines;
+
+            line.reset();
+            line.started = piece.tail_started;
+            line.comment = piece.tail_comment;
+            edges.clear();
+            line.feed(piece.tail, edges);
+            converter->add_edges(edges.data(), edges.size());
         }
+
+        bytesread += cut;
+        LOG(INFO) << "Read " << linenum << " lines, "
+                  << bytesread / 1024 / 1024. << " MB" << std::endl;
+        carry = len - cut;
+        memmove(&buf[0], &buf[cut], carry);
     }
-    free(s);
-    fclose(inf);
+    if (line.started)
+        line.check(++linenum);
+    close(fd);
+}
+
+template <typename vid_t>
+void Converter<vid_t>::relabel()
+{
+    Timer timer;
+    timer.start();
+    std::string name = binedgelist_name(basefilename);
+    int fd = open(name.c_str(), O_RDWR);
+    PCHECK(fd != -1) << "Error opening `" << name << "' for relabeling";
+    size_t header = sizeof(vid_t) + sizeof(size_t);
+    size_t filesize = header + num_edges * sizeof(edge_t);
+    char *map = (char *)mmap(0, filesize, PROT_READ | PROT_WRITE, MAP_SHARED,
+                             fd, 0);
+    if (map == MAP_FAILED) {
+        close(fd);
+        PLOG(FATAL) << "error mapping the file";
+    }
+
+    num_vertices = relabel_edges((edge_t *)(map + header), num_edges, degrees,
+                                 FLAGS_memsize * 1024 * 1024);
+    *(vid_t *)map = num_vertices;
+    *(size_t *)(map + sizeof(vid_t)) = num_edges;
+    PCHECK(munmap(map, filesize) != -1) << "Error un-mmapping the file";
+    close(fd);
+
+    fout.open(degree_name(basefilename));
+    fout.write((char *)&degrees[0], num_vertices * sizeof(vid_t));
+    fout.close();
+    timer.stop();
+    LOG(INFO) << "relabel time: " << timer.get_time();
 }
 
-void convert(std::string basefilename, Converter *converter)
+template <typename vid_t>
+void convert(std::string basefilename, Converter<vid_t> *converter)
 {
     LOG(INFO) << "converting `" << basefilename << "'";
     if (basefilename.empty())
@@ -134,3 +427,7 @@ void convert(std::string basefilename, Converter *converter)
     converter->finalize();
 }
 
+template class Converter<uint32_t>;
+template class Converter<uint64_t>;
+template void convert(std::string, Converter<uint32_t> *);
+template void convert(std::string, Converter<uint64_t> *);
@@ -6,18 +6,27 @@
 #include <boost/unordered_map.hpp>
 
 #include "util.hpp"
+#include "block_writer.hpp"
+#include "edge_codec.hpp"
+#include "manifest.hpp"
 
 DECLARE_string(filetype);
+DECLARE_string(relabel);
 
+template <typename vid_t>
 class Converter
 {
+  public:
+    typedef basic_edge_t<vid_t> edge_t;
+
   protected:
     std::string basefilename;
     vid_t num_vertices;
     size_t num_edges;
     std::vector<vid_t> degrees;
-    std::ofstream fout;
+    block_writer fout;
     boost::unordered_map<vid_t, vid_t> name2vid;
+    std::vector<edge_t> batch;
 
     vid_t get_vid(vid_t v)
     {
@@ -30,17 +39,62 @@ class Converter
         return name2vid[v];
     }
 
+    /* Writes the edge with its raw ids; finalize() relabels the file */
+    void add_raw_edge(vid_t from, vid_t to)
+    {
+        num_edges++;
+        fout.write((char *)&from, sizeof(vid_t));
+        fout.write((char *)&to, sizeof(vid_t));
+    }
+
+    void relabel();
+
+    /* Describes the cache files this converter produces */
+    virtual cache_manifest manifest()
+    {
+        cache_manifest m(manifest_name(basefilename), basefilename);
+        m.set("filetype", FLAGS_filetype);
+        m.set("vid_size", sizeof(vid_t));
+        m.set("compress", FLAGS_compress);
+        m.add_output(FLAGS_compress ? cbinedgelist_name(basefilename)
+                                    : binedgelist_name(basefilename));
+        m.add_output(degree_name(basefilename));
+        return m;
+    }
+
+    /* Completes the raw .binedgelist and writes the .degree file */
+    void finish()
+    {
+        if (FLAGS_relabel == "parallel") {
+            fout.close();
+            relabel();
+            return;
+        }
+        fout.write_at(0, (char *)&num_vertices, sizeof(num_vertices));
+        fout.write_at(sizeof(num_vertices), (char *)&num_edges,
+                      sizeof(num_edges));
+        fout.close();
+
+        fout.open(degree_name(basefilename));
+        fout.write((char *)&degrees[0], num_vertices * sizeof(vid_t));
+        fout.close();
+    }
+
   public:
     Converter(std::string basefilename) : basefilename(basefilename) {}
     virtual ~Converter() {}
-    virtual bool done() { return is_exists(binedgelist_name(basefilename)); }
+    virtual bool done() { return manifest().valid(FLAGS_verify_cache); }
 
     virtual void init()
     {
+        Converter::manifest().invalidate();
+        // the hilbert files are derived from the edge list
+        remove(hilbert_name(basefilename).c_str());
+        remove(sorted_hilbert_name(basefilename).c_str());
         num_vertices = 0;
         num_edges = 0;
         degrees.reserve(1<<20);
-        fout.open(binedgelist_name(basefilename), std::ios::binary);
+        fout.open(binedgelist_name(basefilename));
         fout.write((char *)&num_vertices, sizeof(num_vertices));
         fout.write((char *)&num_edges, sizeof(num_edges));
     }
@@ -52,6 +106,10 @@ class Converter
                          << std::endl;
             return;
         }
+        if (FLAGS_relabel == "parallel") {
+            add_raw_edge(from, to);
+            return;
+        }
 
         num_edges++;
         from = get_vid(from);
@@ -63,16 +121,51 @@ class Converter
         fout.write((char *)&to, sizeof(vid_t));
     }
 
-    virtual void finalize() {
-        fout.seekp(0);
-        fout.write((char *)&num_vertices, sizeof(num_vertices));
-        fout.write((char *)&num_edges, sizeof(num_edges));
-        fout.close();
+    /* Adds a batch of edges in order; the parsers hand over whole ranges.
+     * Subclasses that redefine add_edge must redefine this as well. */
+    virtual void add_edges(const edge_t *edges, size_t n)
+    {
+        if (FLAGS_relabel == "parallel") {
+            // write the runs between self-edges as they are
+            for (size_t i = 0, j = 0; i < n; i = j + 1) {
+                for (j = i; j < n && edges[j].first != edges[j].second; j++)
+                    ;
+                fout.write((char *)(edges + i), (j - i) * sizeof(edge_t));
+                num_edges += j - i;
+                if (j < n)
+                    LOG(WARNING) << "Tried to add self-edge " << edges[j].first
+                                 << "->" << edges[j].second << std::endl;
+            }
+            return;
+        }
 
-        fout.open(degree_name(basefilename), std::ios::binary);
-        fout.write((char *)&degrees[0], num_vertices * sizeof(vid_t));
-        fout.close();
+        batch.clear();
+        for (size_t i = 0; i < n; i++) {
+            vid_t from = edges[i].first, to = edges[i].second;
+            if (to == from) {
+                LOG(WARNING) << "Tried to add self-edge " << from << "->" << to
+                             << std::endl;
+                continue;
+            }
+            from = get_vid(from);
+            to = get_vid(to);
+            degrees[from]++;
+            degrees[to]++;
+            batch.push_back(edge_t(from, to));
+        }
+        num_edges += batch.size();
+        fout.write((char *)batch.data(), batch.size() * sizeof(edge_t));
+    }
+
+    virtual void finalize()
+    {
+        finish();
+        if (FLAGS_compress)
+            compress_edgelist<vid_t>(binedgelist_name(basefilename),
+                                     cbinedgelist_name(basefilename));
+        manifest().commit();
     }
 };
 
-void convert(std::string basefilename, Converter *converter);
+template <typename vid_t>
+void convert(std::string basefilename, Converter<vid_t> *converter);
@@ -124,7 +124,7 @@ class dense_bitset
     }
 
     //! Returns the value of the word containing the bit b
-    inline size_t containing_word(size_t b)
+    inline size_t containing_word(size_t b) const
     {
         size_t arrpos, bitpos;
         bit_to_pos(b, arrpos, bitpos);
@@ -0,0 +1,242 @@
+#include <cstring>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+#include <unistd.h>
+#include <omp.h>
+
+#include "edge_codec.hpp"
+#include "block_writer.hpp"
+
+namespace
+{
+
+const char ZMAGIC[8] = {'E', 'P', 'Z', 'E', 'D', 'G', 'E', '1'};
+
+inline void put_varint(std::vector<uint8_t> &out, uint64_t x)
+{
+    while (x >= 0x80) {
+        out.push_back((uint8_t)x | 0x80);
+        x >>= 7;
+    }
+    out.push_back((uint8_t)x);
+}
+
+inline uint64_t get_varint(const uint8_t *&p)
+{
+    uint64_t x = 0;
+    for (int shift = 0;; shift += 7) {
+        uint8_t b = *p++;
+        x |= (uint64_t)(b & 0x7f) << shift;
+        if (b < 0x80)
+            return x;
+    }
+}
+
+template <typename vid_t>
+inline uint64_t zigzag(vid_t a, vid_t b)
+{
+    int64_t d = (int64_t)a - (int64_t)b;
+    return ((uint64_t)d << 1) ^ (uint64_t)(d >> 63);
+}
+
+template <typename vid_t>
+inline vid_t unzigzag(uint64_t z, vid_t b)
+{
+    return (vid_t)((int64_t)b + (int64_t)((z >> 1) ^ -(z & 1)));
+}
+
+template <typename vid_t>
+void encode_block(const basic_edge_t<vid_t> *edges, size_t n,
+                  std::vector<uint8_t> &out)
+{
+    uint32_t nedges = n;
+    out.resize(sizeof(nedges));
+    memcpy(&out[0], &nedges, sizeof(nedges));
+    vid_t prev = 0;
+    for (size_t i = 0; i < n; i++) {
+        put_varint(out, zigzag(edges[i].first, prev));
+        put_varint(out, zigzag(edges[i].second, edges[i].first));
+        prev = edges[i].first;
+    }
+}
+
+} // namespace
+
+template <typename vid_t>
+void compress_edges(const std::string &filename, vid_t num_vertices,
+                    const basic_edge_t<vid_t> *edges, size_t num_edges)
+{
+    zedgelist_header_t header;
+    memcpy(header.magic, ZMAGIC, sizeof(ZMAGIC));
+    header.vid_size = sizeof(vid_t);
+    header.num_vertices = num_vertices;
+    header.num_edges = num_edges;
+    header.num_blocks = (num_edges + ZBLOCK_EDGES - 1) / ZBLOCK_EDGES;
+
+    block_writer fout(filename);
+    fout.write((char *)&header, sizeof(header));
+
+    // encode one group of blocks in parallel, then write it in order
+    std::vector<uint64_t> index(header.num_blocks);
+    std::vector<std::vector<uint8_t>> group(4 * omp_get_max_threads());
+    for (size_t first = 0; first < header.num_blocks; first += group.size()) {
+        size_t n = std::min(group.size(), header.num_blocks - first);
+#pragma omp parallel for schedule(dynamic)
+        for (size_t i = 0; i < n; i++) {
+            size_t b = first + i;
+            encode_block(edges + b * ZBLOCK_EDGES,
+                         std::min(ZBLOCK_EDGES, num_edges - b * ZBLOCK_EDGES),
+                         group[i]);
+        }
+        for (size_t i = 0; i < n; i++) {
+            index[first + i] = fout.tell();
+            fout.write((char *)group[i].data(), group[i].size());
+        }
+    }
+    header.index_offset = fout.tell();
+    fout.write((char *)index.data(), index.size() * sizeof(uint64_t));
+    fout.write_at(0, (char *)&header, sizeof(header));
+    fout.close();
+}
+
+template <typename vid_t>
+void compress_edgelist(const std::string &from, const std::string &to)
+{
+    typedef basic_edge_t<vid_t> edge_t;
+
+    Timer timer;
+    timer.start();
+    int fd = open(from.c_str(), O_RDONLY);
+    PCHECK(fd != -1) << "Error opening `" << from << "' for read";
+    struct stat fileInfo = {0};
+    PCHECK(fstat(fd, &fileInfo) != -1) << "Error getting the file size";
+    char *map =
+        (char *)mmap(0, fileInfo.st_size, PROT_READ, MAP_SHARED, fd, 0);
+    if (map == MAP_FAILED) {
+        close(fd);
+        PLOG(FATAL) << "error mapping the file";
+    }
+    madvise(map, fileInfo.st_size, MADV_SEQUENTIAL);
+
+    vid_t num_vertices = *(vid_t *)map;
+    size_t num_edges = *(size_t *)(map + sizeof(vid_t));
+    CHECK_EQ(sizeof(vid_t) + sizeof(size_t) + num_edges * sizeof(edge_t),
+             fileInfo.st_size);
+    compress_edges(to, num_vertices,
+                   (edge_t *)(map + sizeof(vid_t) + sizeof(size_t)), num_edges);
+
+    munmap(map, fileInfo.st_size);
+    close(fd);
+    remove(from.c_str());
+    timer.stop();
+    LOG(INFO) << "compressed `" << from << "' to "
+              << 100. * file_size(to) / fileInfo.st_size << "% in "
+              << timer.get_time() << "s";
+}
+
+bool is_compressed_edgelist(const std::string &filename)
+{
+    char magic[sizeof(ZMAGIC)];
+    int fd = open(filename.c_str(), O_RDONLY);
+    PCHECK(fd != -1) << "Error opening `" << filename << "' for read";
+    bool compressed = read(fd, magic, sizeof(magic)) == sizeof(magic) &&
+                      memcmp(magic, ZMAGIC, sizeof(ZMAGIC)) == 0;
+    close(fd);
+    return compressed;
+}
+
+template <typename vid_t>
+void edge_decoder<vid_t>::open(const std::string &filename)
+{
+    fd = ::open(filename.c_str(), O_RDONLY);
+    PCHECK(fd != -1) << "Error opening `" << filename << "' for read";
+    struct stat fileInfo = {0};
+    PCHECK(fstat(fd, &fileInfo) != -1) << "Error getting the file size";
+    filesize = fileInfo.st_size;
+    CHECK_GE(filesize, sizeof(zedgelist_header_t))
+        << "`" << filename << "' is not a compressed edge list";
+    map = (char *)mmap(0, filesize, PROT_READ, MAP_SHARED, fd, 0);
+    if (map == MAP_FAILED) {
+        ::close(fd);
+        PLOG(FATAL) << "error mapping the file";
+    }
+    madvise(map, filesize, MADV_SEQUENTIAL);
+
+    header = (const zedgelist_header_t *)map;
+    CHECK(memcmp(header->magic, ZMAGIC, sizeof(ZMAGIC)) == 0)
+        << "`" << filename << "' is not a compressed edge list";
+    CHECK_EQ(header->vid_size, sizeof(vid_t)) << "vertex id size mismatch";
+    CHECK_EQ(header->index_offset + header->num_blocks * sizeof(uint64_t),
+             filesize);
+    index = (const uint64_t *)(map + header->index_offset);
+    next_block = 0;
+}
+
+template <typename vid_t>
+void edge_decoder<vid_t>::close()
+{
+    if (map) {
+        munmap(map, filesize);
+        map = NULL;
+    }
+    if (fd != -1) {
+        ::close(fd);
+        fd = -1;
+    }
+}
+
+template <typename vid_t>
+void edge_decoder<vid_t>::decode_block(size_t b, edge_t *edges) const
+{
+    const uint8_t *p = (const uint8_t *)map + index[b];
+    uint32_t n;
+    memcpy(&n, p, sizeof(n));
+    p += sizeof(n);
+    CHECK_EQ(n, block_size(b)) << "corrupted block " << b;
+    vid_t prev = 0;
+    for (uint32_t i = 0; i < n; i++) {
+        edges[i].first = unzigzag(get_varint(p), prev);
+        edges[i].second = unzigzag(get_varint(p), edges[i].first);
+        prev = edges[i].first;
+    }
+}
+
+template <typename vid_t>
+size_t edge_decoder<vid_t>::next(std::vector<edge_t> &edges, size_t max_edges)
+{
+    if (max_edges == 0)
+        max_edges = 4 * omp_get_max_threads() * ZBLOCK_EDGES;
+    size_t nblocks = std::max((size_t)1, max_edges / ZBLOCK_EDGES);
+    nblocks = std::min(nblocks, header->num_blocks - next_block);
+    if (nblocks == 0)
+        return 0;
+    size_t first = next_block;
+    next_block += nblocks;
+    size_t n = std::min(nblocks * ZBLOCK_EDGES,
+                        header->num_edges - first * ZBLOCK_EDGES);
+    edges.resize(n);
+#pragma omp parallel for schedule(dynamic)
+    for (size_t i = 0; i < nblocks; i++)
+        decode_block(first + i, &edges[i * ZBLOCK_EDGES]);
+    return n;
+}
+
+template <typename vid_t>
+void edge_decoder<vid_t>::decode_all(edge_t *edges) const
+{
+#pragma omp parallel for schedule(dynamic)
+    for (size_t b = 0; b < header->num_blocks; b++)
+        decode_block(b, edges + b * ZBLOCK_EDGES);
+}
+
+template void compress_edges(const std::string &, uint32_t,
+                             const basic_edge_t<uint32_t> *, size_t);
+template void compress_edges(const std::string &, uint64_t,
+                             const basic_edge_t<uint64_t> *, size_t);
+template void compress_edgelist<uint32_t>(const std::string &,
+                                          const std::string &);
+template void compress_edgelist<uint64_t>(const std::string &,
+                                          const std::string &);
+template class edge_decoder<uint32_t>;
+template class edge_decoder<uint64_t>;
@@ -0,0 +1,75 @@
+#pragma once
+
+#include <string>
+#include <vector>
+
+#include "util.hpp"
+
+DECLARE_bool(compress);
+
+/*
+ * Compressed edge list (.cbinedgelist): a header, blocks of up to
+ * ZBLOCK_EDGES edges and an index with the file offset of every block.
+ * A block starts with its number of edges; every edge is stored as the
+ * zigzag varint delta of its source to the previous source, followed by
+ * the zigzag varint delta of its target to its source. Blocks are
+ * independent, so they are encoded and decoded in parallel.
+ */
+const size_t ZBLOCK_EDGES = 1 << 16;
+
+struct zedgelist_header_t {
+    char magic[8];
+    uint64_t vid_size;
+    uint64_t num_vertices, num_edges;
+    uint64_t num_blocks, index_offset;
+};
+
+/* Writes edges[0..num_edges) to filename in the compressed format */
+template <typename vid_t>
+void compress_edges(const std::string &filename, vid_t num_vertices,
+                    const basic_edge_t<vid_t> *edges, size_t num_edges);
+
+/* Replaces the raw edge list `from' with its compressed version `to' */
+template <typename vid_t>
+void compress_edgelist(const std::string &from, const std::string &to);
+
+/* Tells a compressed edge list from a raw one by its magic */
+bool is_compressed_edgelist(const std::string &filename);
+
+template <typename vid_t>
+class edge_decoder
+{
+  public:
+    typedef basic_edge_t<vid_t> edge_t;
+
+  private:
+    int fd;
+    size_t filesize, next_block;
+    char *map;
+    const zedgelist_header_t *header;
+    const uint64_t *index;
+
+    size_t block_size(size_t b) const
+    {
+        return std::min(ZBLOCK_EDGES, header->num_edges - b * ZBLOCK_EDGES);
+    }
+    void decode_block(size_t b, edge_t *edges) const;
+
+  public:
+    edge_decoder() : fd(-1), map(NULL) {}
+    ~edge_decoder() { close(); }
+
+    void open(const std::string &filename);
+    void close();
+
+    vid_t num_vertices() const { return header->num_vertices; }
+    size_t num_edges() const { return header->num_edges; }
+
+    /* Decodes the next blocks, at least one and about max_edges edges in
+     * total (four blocks per thread by default), into edges; returns the
+     * number of edges, 0 at the end */
+    size_t next(std::vector<edge_t> &edges, size_t max_edges = 0);
+
+    /* Decodes the whole file into edges[0..num_edges()) */
+    void decode_all(edge_t *edges) const;
+};
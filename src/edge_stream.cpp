@@ -0,0 +1,132 @@
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+#include "edge_stream.hpp"
+
+template <typename vid_t>
+void edge_stream<vid_t>::open(const std::string &filename)
+{
+    CHECK(fd == -1 && map == NULL) << "stream is already open";
+    CHECK(FLAGS_input_backend == "mmap" || FLAGS_input_backend == "pread")
+        << "unknown input backend: " << FLAGS_input_backend;
+    compressed = is_compressed_edgelist(filename);
+    use_mmap = !compressed && FLAGS_input_backend == "mmap";
+    pos = file_pos = 0;
+    current.clear();
+
+    if (compressed) {
+        decoder.open(filename);
+        nvertices = decoder.num_vertices();
+        nedges = decoder.num_edges();
+        prefetch();
+        return;
+    }
+
+    fd = ::open(filename.c_str(), O_RDONLY);
+    PCHECK(fd != -1) << "Error opening `" << filename << "' for read";
+    struct stat fileInfo = {0};
+    PCHECK(fstat(fd, &fileInfo) != -1) << "Error getting the file size";
+    filesize = fileInfo.st_size;
+    LOG(INFO) << "file size: " << filesize;
+    size_t header = sizeof(vid_t) + sizeof(size_t);
+    CHECK_GE(filesize, header) << "`" << filename << "' is not an edge list";
+    preada(fd, (char *)&nvertices, sizeof(vid_t), 0);
+    preada(fd, (char *)&nedges, sizeof(size_t), sizeof(vid_t));
+    CHECK_EQ(header + nedges * sizeof(edge_t), filesize)
+        << "`" << filename << "' does not match its header";
+
+    if (use_mmap) {
+        map = (char *)mmap(0, filesize, PROT_READ, MAP_SHARED, fd, 0);
+        if (map == MAP_FAILED) {
+            map = NULL;
+            ::close(fd);
+            PLOG(FATAL) << "error mapping the file";
+        }
+        madvise(map, filesize, MADV_SEQUENTIAL);
+        edges = (const edge_t *)(map + header);
+        advised = 0;
+    } else {
+        posix_fadvise(fd, 0, 0, POSIX_FADV_SEQUENTIAL);
+        prefetch();
+    }
+}
+
+template <typename vid_t>
+void edge_stream<vid_t>::close()
+{
+    if (pending.valid())
+        pending.wait();
+    pending = std::future<size_t>();
+    if (map) {
+        munmap(map, filesize);
+        map = NULL;
+    }
+    if (fd != -1) {
+        ::close(fd);
+        fd = -1;
+    }
+    decoder.close();
+    std::vector<edge_t>().swap(current);
+    std::vector<edge_t>().swap(ahead);
+}
+
+template <typename vid_t>
+size_t edge_stream<vid_t>::fill(std::vector<edge_t> &buf)
+{
+    if (compressed)
+        return decoder.next(buf, batch_edges);
+    size_t n = std::min(batch_edges, nedges - file_pos);
+    buf.resize(n);
+    if (n > 0)
+        preada(fd, (char *)&buf[0], n * sizeof(edge_t),
+               sizeof(vid_t) + sizeof(size_t) + file_pos * sizeof(edge_t));
+    file_pos += n;
+    return n;
+}
+
+template <typename vid_t>
+void edge_stream<vid_t>::prefetch()
+{
+    pending = pool.postWork<size_t>([this]() { return fill(ahead); });
+}
+
+template <typename vid_t>
+size_t edge_stream<vid_t>::next(const edge_t *&batch, size_t max_edges)
+{
+    if (max_edges == 0)
+        max_edges = batch_edges;
+
+    if (use_mmap) {
+        if (pos == nedges)
+            return 0;
+        size_t n = std::min(max_edges, nedges - pos);
+        // keep at least one batch advised ahead of the reader
+        if (advised < nedges && pos + n + batch_edges > advised) {
+            size_t to = std::min(nedges, pos + n + 2 * batch_edges);
+            size_t page = sysconf(_SC_PAGESIZE);
+            char *begin = (char *)((uintptr_t)(edges + advised) & ~(page - 1));
+            madvise(begin, (char *)(edges + to) - begin, MADV_WILLNEED);
+            advised = to;
+        }
+        batch = edges + pos;
+        pos += n;
+        return n;
+    }
+
+    if (pos == current.size()) {
+        if (!pending.valid() || pending.get() == 0)
+            return 0;
+        current.swap(ahead);
+        pos = 0;
+        prefetch();
+    }
+    size_t n = std::min(max_edges, current.size() - pos);
+    batch = &current[pos];
+    pos += n;
+    return n;
+}
+
+template class edge_stream<uint32_t>;
+template class edge_stream<uint64_t>;
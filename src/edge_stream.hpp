@@ -0,0 +1,65 @@
+#pragma once
+
+#include <string>
+#include <vector>
+#include <future>
+
+#include "util.hpp"
+#include "edge_codec.hpp"
+
+DECLARE_string(input_backend);
+DECLARE_uint64(read_blocksize);
+
+/*
+ * Sequential reader of a converted edge list, raw or compressed, that hands
+ * out the edges in batches. A raw list is either mapped, with the window
+ * ahead of the reader advised with MADV_WILLNEED, or read with pread into
+ * two buffers, the next one being filled on the thread pool while the
+ * caller works on the current one. Compressed blocks are decoded ahead in
+ * the same way. A batch stays valid until the next call to next().
+ */
+template <typename vid_t>
+class edge_stream
+{
+  public:
+    typedef basic_edge_t<vid_t> edge_t;
+
+  private:
+    int fd;
+    bool compressed, use_mmap;
+    size_t filesize, batch_edges;
+    vid_t nvertices;
+    size_t nedges;
+
+    // mmap backend: the edges and the end of the advised window
+    char *map;
+    const edge_t *edges;
+    size_t pos, advised;
+
+    // buffered backends: the batch handed out and the one read ahead
+    std::vector<edge_t> current, ahead;
+    size_t file_pos;
+    std::future<size_t> pending;
+    edge_decoder<vid_t> decoder;
+
+    size_t fill(std::vector<edge_t> &buf);
+    void prefetch();
+
+  public:
+    edge_stream(size_t batch_size = FLAGS_read_blocksize * 1024 * 1024)
+        : fd(-1), batch_edges(std::max((size_t)1, batch_size / sizeof(edge_t))),
+          map(NULL)
+    {
+    }
+    ~edge_stream() { close(); }
+
+    void open(const std::string &filename);
+    void close();
+
+    vid_t num_vertices() const { return nvertices; }
+    size_t num_edges() const { return nedges; }
+
+    /* Points batch to the next at most max_edges edges (a whole read-ahead
+     * batch by default) and returns their number, 0 at the end */
+    size_t next(const edge_t *&batch, size_t max_edges = 0);
+};
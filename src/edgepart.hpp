@@ -1,81 +1,647 @@
 #pragma once
 
 #include <string>
-#include <sstream>
-#include <iostream>
-#include <fstream>
+#include <vector>
+#include <utility>
+#include <memory>
+#include <thread>
+#include <atomic>
+#include <chrono>
+#include <cstring>
+#include <limits>
+#include <omp.h>
 
+#include "concurrentqueue.h"
 #include "util.hpp"
+#include "block_writer.hpp"
 
-template <typename vertex_type, typename proc_type>
-struct edgepart_writer {
-    char *buffer;
-    std::ofstream fout;
+DECLARE_string(output_format);
+DECLARE_bool(output_index);
+DECLARE_bool(output_shards);
+DECLARE_bool(async_output);
+DECLARE_bool(output_subgraphs);
 
-    edgepart_writer(const std::string &basefilename)
-        : fout(partitioned_name(basefilename))
+/*
+ * Output of a partitioner: the partition of every edge and the master
+ * partition of every vertex. The format is picked by new_edgepart_writer().
+ */
+template <typename vid_t, typename proc_t>
+class edgepart_writer
+{
+  public:
+    virtual ~edgepart_writer() {}
+
+    virtual void save_vertex(vid_t v, proc_t proc) = 0;
+    virtual void save_edge(vid_t from, vid_t to, proc_t proc) = 0;
+
+    /* Saves n edges at once, edges[i] to partition procs[i]; the formats
+     * override it to format the records in parallel */
+    virtual void save_edges(const basic_edge_t<vid_t> *edges,
+                            const proc_t *procs, size_t n)
+    {
+        for (size_t i = 0; i < n; i++)
+            save_edge(edges[i].first, edges[i].second, procs[i]);
+    }
+
+    /* Completes the output, nothing can be saved afterwards */
+    virtual void close() = 0;
+};
+
+/*
+ * The line-based format read by PowerGraph: a tag byte (0: vertex, 1: edge)
+ * followed by the raw ids and partition, with \255 escaped as \255\1 and
+ * \n as \255\0, and a terminating \n.
+ */
+template <typename vid_t, typename proc_t>
+class text_edgepart_writer : public edgepart_writer<vid_t, proc_t>
+{
+  private:
+    static const size_t MAX_RECORD = 1 + 2 * sizeof(vid_t) + sizeof(proc_t);
+
+    static const size_t MAX_LINE = 2 * MAX_RECORD + 1;
+
+    block_writer fout;
+    char line[MAX_LINE];
+    std::vector<std::vector<char>> lines; // per thread, for save_edges
+
+    /* Escapes the record of n bytes into line and returns its length */
+    static size_t escape(const char *record, size_t n, char *line)
+    {
+        size_t len = 0;
+        for (size_t i = 0; i < n; i++) {
+            if (record[i] == (char)255) {
+                line[len++] = (char)255;
+                line[len++] = 1;
+            } else if (record[i] == '\n') {
+                line[len++] = (char)255;
+                line[len++] = 0;
+            } else
+                line[len++] = record[i];
+        }
+        line[len++] = '\n';
+        return len;
+    }
+
+    static size_t format_edge(vid_t from, vid_t to, proc_t proc, char *line)
+    {
+        char record[MAX_RECORD];
+        record[0] = 1;
+        memcpy(record + 1, &from, sizeof(vid_t));
+        memcpy(record + 1 + sizeof(vid_t), &to, sizeof(vid_t));
+        memcpy(record + 1 + 2 * sizeof(vid_t), &proc, sizeof(proc_t));
+        return escape(record, MAX_RECORD, line);
+    }
+
+  public:
+    text_edgepart_writer(const std::string &filename, size_t block_size)
+        : fout(filename, block_size)
+    {
+    }
+
+    void save_vertex(vid_t v, proc_t proc)
+    {
+        char record[MAX_RECORD];
+        record[0] = 0;
+        memcpy(record + 1, &v, sizeof(vid_t));
+        memcpy(record + 1 + sizeof(vid_t), &proc, sizeof(proc_t));
+        fout.write(line, escape(record, 1 + sizeof(vid_t) + sizeof(proc_t),
+                                line));
+    }
+
+    void save_edge(vid_t from, vid_t to, proc_t proc)
+    {
+        fout.write(line, format_edge(from, to, proc, line));
+    }
+
+    void save_edges(const basic_edge_t<vid_t> *edges, const proc_t *procs,
+                    size_t n)
+    {
+        // every thread escapes a contiguous slice, written out in order
+        lines.resize(omp_get_max_threads());
+#pragma omp parallel
+        {
+            int t = omp_get_thread_num(), nthreads = omp_get_num_threads();
+            std::vector<char> &out = lines[t];
+            size_t begin = n * t / nthreads, end = n * (t + 1) / nthreads;
+            out.resize((end - begin) * MAX_LINE);
+            size_t len = 0;
+            for (size_t i = begin; i < end; i++)
+                len += format_edge(edges[i].first, edges[i].second, procs[i],
+                                   &out[len]);
+            out.resize(len);
+        }
+        for (auto &out : lines)
+            if (!out.empty())
+                fout.write(&out[0], out.size());
+    }
+
+    void close() { fout.close(); }
+};
+
+/*
+ * Binary partition file, laid out to be mapped by the loaders:
+ *
+ *   header   edgepart_header
+ *   edges    edgepart_edge_t<vid_t, proc_t>[num_edges]
+ *   masters  edgepart_vertex_t<vid_t, proc_t>[num_vertices]
+ *   index    optional, 8-byte aligned
+ *   footer   edgepart_footer, the last bytes of the file
+ *
+ * Records are the plain structs below in host byte order. A shard of a
+ * sharded output holds the records of partition `shard' only. With the index,
+ * the records of each section are stored in runs of a single partition and
+ * the index holds, for the edges and then for the masters, num_partitions + 1
+ * offsets into a list of runs followed by that list; the runs of partition i
+ * are runs[begin[i]] .. runs[begin[i + 1] - 1], each a (first record, number
+ * of records) pair.
+ */
+const char EDGEPART_MAGIC[8] = {'E', 'D', 'G', 'E', 'P', 'A', 'R', 'T'};
+const uint32_t EDGEPART_VERSION = 1;
+const uint32_t EDGEPART_INDEXED = 1;
+const uint32_t EDGEPART_SHARD = 2;
+
+struct edgepart_header {
+    char magic[8];
+    uint32_t version, flags;
+    uint32_t vid_size, proc_size;
+    uint32_t num_partitions, shard;
+};
+
+struct edgepart_footer {
+    uint64_t num_edges, num_vertices;
+    uint64_t edges_offset, vertices_offset, index_offset; // index: 0 if none
+    char magic[8];
+};
+
+template <typename vid_t, typename proc_t>
+struct edgepart_edge_t {
+    vid_t first, second;
+    proc_t proc;
+};
+
+template <typename vid_t, typename proc_t>
+struct edgepart_vertex_t {
+    vid_t v;
+    proc_t proc;
+};
+
+template <typename vid_t, typename proc_t>
+class binary_edgepart_writer : public edgepart_writer<vid_t, proc_t>
+{
+  private:
+    typedef edgepart_edge_t<vid_t, proc_t> edge_record;
+    typedef edgepart_vertex_t<vid_t, proc_t> vertex_record;
+    typedef std::pair<uint64_t, uint64_t> run_t;
+
+    /* Records of one kind; with the index they are staged per partition
+     * and written out a run at a time */
+    template <typename record_t>
+    struct section {
+        uint64_t offset, count;
+        std::vector<std::vector<record_t>> staged;
+        std::vector<std::vector<run_t>> runs;
+    };
+
+    block_writer fout;
+    int num_partitions;
+    bool indexed, in_masters;
+    size_t run_records;
+    section<edge_record> edges;
+    section<vertex_record> masters;
+    std::vector<edge_record> records; // for save_edges
+
+    template <typename record_t>
+    void begin(section<record_t> &s)
+    {
+        s.offset = fout.tell();
+        s.count = 0;
+        if (indexed) {
+            s.staged.resize(num_partitions);
+            s.runs.resize(num_partitions);
+        }
+    }
+
+    template <typename record_t>
+    void flush_run(section<record_t> &s, proc_t proc)
+    {
+        std::vector<record_t> &buf = s.staged[proc];
+        if (buf.empty())
+            return;
+        s.runs[proc].push_back(run_t(s.count, buf.size()));
+        fout.write((const char *)&buf[0], buf.size() * sizeof(record_t));
+        s.count += buf.size();
+        buf.clear();
+    }
+
+    template <typename record_t>
+    void append(section<record_t> &s, const record_t &r)
+    {
+        if (!indexed) {
+            fout.write((const char *)&r, sizeof(record_t));
+            s.count++;
+            return;
+        }
+        DCHECK_LT(r.proc, num_partitions);
+        std::vector<record_t> &buf = s.staged[r.proc];
+        if (buf.empty())
+            buf.reserve(run_records);
+        buf.push_back(r);
+        if (buf.size() == run_records)
+            flush_run(s, r.proc);
+    }
+
+    template <typename record_t>
+    void end(section<record_t> &s)
+    {
+        if (indexed)
+            rep (i, num_partitions)
+                flush_run(s, i);
+        std::vector<std::vector<record_t>>().swap(s.staged);
+    }
+
+    template <typename record_t>
+    void write_index(const section<record_t> &s)
+    {
+        std::vector<uint64_t> first(num_partitions + 1, 0);
+        rep (i, num_partitions)
+            first[i + 1] = first[i] + s.runs[i].size();
+        fout.write((const char *)&first[0], first.size() * sizeof(uint64_t));
+        for (auto &runs : s.runs)
+            for (auto &run : runs) {
+                uint64_t entry[2] = {run.first, run.second};
+                fout.write((const char *)entry, sizeof(entry));
+            }
+    }
+
+    void start_masters()
+    {
+        end(edges);
+        begin(masters);
+        in_masters = true;
+    }
+
+  public:
+    /* shard is -1 unless the file is a shard of a sharded output */
+    binary_edgepart_writer(const std::string &filename, int num_partitions,
+                           bool indexed, int shard, size_t block_size)
+        : fout(filename, block_size), num_partitions(num_partitions),
+          indexed(indexed), in_masters(false)
+    {
+        // the staged runs of all partitions take about one write block
+        run_records = std::max((size_t)1024, block_size / num_partitions /
+                                                 sizeof(edge_record));
+        edgepart_header header;
+        memset(&header, 0, sizeof(header));
+        memcpy(header.magic, EDGEPART_MAGIC, sizeof(header.magic));
+        header.version = EDGEPART_VERSION;
+        header.flags = (indexed ? EDGEPART_INDEXED : 0) |
+                       (shard >= 0 ? EDGEPART_SHARD : 0);
+        header.vid_size = sizeof(vid_t);
+        header.proc_size = sizeof(proc_t);
+        header.num_partitions = num_partitions;
+        header.shard = std::max(shard, 0);
+        fout.write((const char *)&header, sizeof(header));
+        begin(edges);
+    }
+
+    void save_vertex(vid_t v, proc_t proc)
+    {
+        if (!in_masters)
+            start_masters();
+        vertex_record r;
+        memset(&r, 0, sizeof(r));
+        r.v = v;
+        r.proc = proc;
+        append(masters, r);
+    }
+
+    void save_edge(vid_t from, vid_t to, proc_t proc)
+    {
+        DCHECK(!in_masters) << "edges must be saved before the masters";
+        edge_record r;
+        memset(&r, 0, sizeof(r));
+        r.first = from;
+        r.second = to;
+        r.proc = proc;
+        append(edges, r);
+    }
+
+    void save_edges(const basic_edge_t<vid_t> *batch, const proc_t *procs,
+                    size_t n)
+    {
+        if (indexed) {
+            edgepart_writer<vid_t, proc_t>::save_edges(batch, procs, n);
+            return;
+        }
+        DCHECK(!in_masters) << "edges must be saved before the masters";
+        records.resize(n);
+#pragma omp parallel for
+        for (size_t i = 0; i < n; i++) {
+            memset(&records[i], 0, sizeof(edge_record));
+            records[i].first = batch[i].first;
+            records[i].second = batch[i].second;
+            records[i].proc = procs[i];
+        }
+        fout.write((const char *)&records[0], n * sizeof(edge_record));
+        edges.count += n;
+    }
+
+    void close()
+    {
+        if (!in_masters)
+            start_masters();
+        end(masters);
+
+        edgepart_footer footer;
+        memset(&footer, 0, sizeof(footer));
+        footer.num_edges = edges.count;
+        footer.num_vertices = masters.count;
+        footer.edges_offset = edges.offset;
+        footer.vertices_offset = masters.offset;
+        if (indexed) {
+            const char zeros[8] = {0};
+            fout.write(zeros, (8 - fout.tell() % 8) % 8);
+            footer.index_offset = fout.tell();
+            write_index(edges);
+            write_index(masters);
+        }
+        memcpy(footer.magic, EDGEPART_MAGIC, sizeof(footer.magic));
+        fout.write((const char *)&footer, sizeof(footer));
+        fout.close();
+        DLOG(INFO) << "saved " << edges.count << " edges and " << masters.count
+                  << " masters";
+    }
+};
+
+/* A writer of the single file name (plus ".bin" for the binary format) */
+template <typename vid_t, typename proc_t>
+edgepart_writer<vid_t, proc_t> *
+new_edgepart_file_writer(const std::string &name, int num_partitions,
+                         int shard, size_t block_size)
+{
+    if (FLAGS_output_format == "binary")
+        return new binary_edgepart_writer<vid_t, proc_t>(
+            name + ".bin", num_partitions, FLAGS_output_index && shard < 0,
+            shard, block_size);
+    if (FLAGS_output_format != "text")
+        LOG(FATAL) << "unknown output format: " << FLAGS_output_format;
+    return new text_edgepart_writer<vid_t, proc_t>(name, block_size);
+}
+
+/*
+ * One file per partition, so that every worker of the graph system reads
+ * only its own shard. Each shard has its own block writer; with async
+ * writes, the full blocks of different shards are flushed concurrently on
+ * the thread pool, and the shards are closed in parallel.
+ */
+template <typename vid_t, typename proc_t>
+class sharded_edgepart_writer : public edgepart_writer<vid_t, proc_t>
+{
+  private:
+    std::vector<std::unique_ptr<edgepart_writer<vid_t, proc_t>>> shards;
+    // save_edges groups a batch by partition
+    std::vector<basic_edge_t<vid_t>> grouped;
+    std::vector<proc_t> grouped_procs;
+    std::vector<size_t> first;
+
+  public:
+    sharded_edgepart_writer(const std::string &basefilename,
+                            int num_partitions, size_t block_size)
+        : shards(num_partitions)
+    {
+        rep (i, num_partitions)
+            shards[i].reset(new_edgepart_file_writer<vid_t, proc_t>(
+                partitioned_shard_name(basefilename, i), num_partitions, i,
+                block_size));
+    }
+
+    void save_vertex(vid_t v, proc_t proc)
     {
-        size_t s = std::max(sizeof(vertex_type) + sizeof(proc_type),
-                            sizeof(vertex_type) + sizeof(vertex_type) +
-                                sizeof(proc_type));
-        buffer = new char[sizeof(char) + s];
+        DCHECK_LT(proc, shards.size());
+        shards[proc]->save_vertex(v, proc);
     }
 
-    ~edgepart_writer() { delete[] buffer; }
+    void save_edge(vid_t from, vid_t to, proc_t proc)
+    {
+        DCHECK_LT(proc, shards.size());
+        shards[proc]->save_edge(from, to, proc);
+    }
 
-    /**
-     * Replaces \255 with \255\1
-     * Replaces \\n with \255\0
-     */
-    static std::string escape_newline(char *ptr, size_t strmlen)
+    void save_edges(const basic_edge_t<vid_t> *edges, const proc_t *procs,
+                    size_t n)
     {
-        size_t ctr = 0;
-        for (size_t i = 0; i < strmlen; ++i) {
-            ctr += (ptr[i] == (char)255 || ptr[i] == '\n');
+        int p = shards.size();
+        first.assign(p + 1, 0);
+        for (size_t i = 0; i < n; i++)
+            first[procs[i] + 1]++;
+        rep (i, p)
+            first[i + 1] += first[i];
+        grouped.resize(n);
+        grouped_procs.resize(n);
+        std::vector<size_t> pos(first.begin(), first.end() - 1);
+        for (size_t i = 0; i < n; i++) {
+            grouped_procs[pos[procs[i]]] = procs[i];
+            grouped[pos[procs[i]]++] = edges[i];
         }
+#pragma omp parallel for schedule(dynamic)
+        for (int i = 0; i < p; i++)
+            if (first[i + 1] > first[i])
+                shards[i]->save_edges(&grouped[first[i]],
+                                      &grouped_procs[first[i]],
+                                      first[i + 1] - first[i]);
+    }
+
+    void close()
+    {
+#pragma omp parallel for schedule(dynamic)
+        for (size_t i = 0; i < shards.size(); i++)
+            shards[i]->close();
+    }
+};
+
+/*
+ * Moves formatting and I/O off the partitioning loop: the records are
+ * collected into batches that go through a bounded queue to a writer
+ * thread, which hands them to the actual writer. The queue is bounded by a
+ * fixed set of batches recycled through a second queue; when all of them
+ * are in flight the producer waits, and that time is reported at close.
+ * The writer thread is not taken from the pool because the block writers
+ * flush there.
+ */
+template <typename vid_t, typename proc_t>
+class async_edgepart_writer : public edgepart_writer<vid_t, proc_t>
+{
+  private:
+    static const size_t BATCH_RECORDS = 1 << 16, NUM_BATCHES = 8;
+
+    struct record_t {
+        vid_t first, second; // second is unused for a vertex
+        proc_t proc;
+        bool is_vertex;
+    };
+    typedef std::vector<record_t> batch_t;
+
+    std::unique_ptr<edgepart_writer<vid_t, proc_t>> writer;
+    std::vector<batch_t> batches;
+    moodycamel::ConcurrentQueue<batch_t *> full, free_batches;
+    moodycamel::ProducerToken full_token;
+    batch_t *current;
+    std::atomic<size_t> in_flight;
+    std::atomic<bool> finished;
+    std::thread thread;
+
+    Timer blocked_timer, busy_timer;
+    size_t num_waits;
+
+    static void idle()
+    {
+        std::this_thread::sleep_for(std::chrono::microseconds(50));
+    }
 
-        std::string ret(ctr + strmlen, 0);
-
-        size_t target = 0;
-        for (size_t i = 0; i < strmlen; ++i, ++ptr) {
-            if ((*ptr) == (char)255) {
-                ret[target] = (char)255;
-                ret[target + 1] = 1;
-                target += 2;
-            } else if ((*ptr) == '\n') {
-                ret[target] = (char)255;
-                ret[target + 1] = 0;
-                target += 2;
-            } else {
-                ret[target] = (*ptr);
-                ++target;
+    void drain()
+    {
+        batch_t *batch;
+        while (true) {
+            if (!full.try_dequeue_from_producer(full_token, batch)) {
+                // the last batch is queued before finished is set
+                if (!finished.load())
+                    idle();
+                else if (!full.try_dequeue_from_producer(full_token, batch))
+                    break;
+                continue;
             }
+            busy_timer.start();
+            for (auto &r : *batch)
+                if (r.is_vertex)
+                    writer->save_vertex(r.first, r.proc);
+                else
+                    writer->save_edge(r.first, r.second, r.proc);
+            busy_timer.stop();
+            batch->clear();
+            free_batches.enqueue(batch);
+            in_flight--;
+        }
+    }
+
+    void enqueue_current()
+    {
+        if (current->empty())
+            return;
+        in_flight++;
+        full.enqueue(full_token, current);
+        current = NULL;
+    }
+
+    void next_batch()
+    {
+        enqueue_current();
+        if (current || free_batches.try_dequeue(current))
+            return;
+        num_waits++;
+        blocked_timer.start();
+        while (!free_batches.try_dequeue(current))
+            idle();
+        blocked_timer.stop();
+    }
+
+    void push(vid_t first, vid_t second, proc_t proc, bool is_vertex)
+    {
+        record_t r;
+        r.first = first;
+        r.second = second;
+        r.proc = proc;
+        r.is_vertex = is_vertex;
+        current->push_back(r);
+        if (current->size() == BATCH_RECORDS)
+            next_batch();
+    }
+
+  public:
+    async_edgepart_writer(edgepart_writer<vid_t, proc_t> *writer)
+        : writer(writer), batches(NUM_BATCHES), full(NUM_BATCHES),
+          free_batches(NUM_BATCHES), full_token(full), in_flight(0),
+          finished(false), num_waits(0)
+    {
+        for (auto &batch : batches) {
+            batch.reserve(BATCH_RECORDS);
+            free_batches.enqueue(&batch);
         }
-        CHECK_EQ(target, ctr + strmlen);
-        return ret;
+        free_batches.try_dequeue(current);
+        thread = std::thread(&async_edgepart_writer::drain, this);
+    }
+
+    ~async_edgepart_writer()
+    {
+        if (thread.joinable())
+            close();
+    }
+
+    void save_vertex(vid_t v, proc_t proc) { push(v, 0, proc, true); }
+
+    void save_edge(vid_t from, vid_t to, proc_t proc)
+    {
+        push(from, to, proc, false);
     }
 
-    void save_vertex(vertex_type v, proc_type proc)
+    /* Saves the batch with the parallel save_edges of the writer, after the
+     * writer thread has caught up */
+    void save_edges(const basic_edge_t<vid_t> *edges, const proc_t *procs,
+                    size_t n)
     {
-        buffer[0] = 0;
-        memcpy(buffer + 1, &v, sizeof(vertex_type));
-        memcpy(buffer + 1 + sizeof(vertex_type), &proc,
-               sizeof(proc_type));
-        std::string result = escape_newline(
-            buffer, 1 + sizeof(vertex_type) + sizeof(proc_type));
-        fout << result << '\n';
+        if (!current->empty())
+            next_batch();
+        if (in_flight.load() > 0) {
+            num_waits++;
+            blocked_timer.start();
+            while (in_flight.load() > 0)
+                idle();
+            blocked_timer.stop();
+        }
+        writer->save_edges(edges, procs, n);
     }
 
-    void save_edge(vertex_type from, vertex_type to, proc_type proc)
+    void close()
     {
-        buffer[0] = 1;
-        memcpy(buffer + 1, &from, sizeof(vertex_type));
-        memcpy(buffer + 1 + sizeof(vertex_type), &to, sizeof(vertex_type));
-        memcpy(buffer + 1 + sizeof(vertex_type) + sizeof(vertex_type), &proc,
-               sizeof(proc_type));
-        std::string result = escape_newline(buffer, 1 + sizeof(vertex_type) +
-                                                        sizeof(vertex_type) +
-                                                        sizeof(proc_type));
-        fout << result << '\n';
+        if (current)
+            enqueue_current();
+        finished.store(true);
+        thread.join();
+        writer->close();
+        LOG(INFO) << "output: partitioner blocked " << blocked_timer.get_time()
+                  << "s in " << num_waits << " waits, writer busy "
+                  << busy_timer.get_time() << "s";
     }
 };
+
+/* Adds local subgraphs to the output of writer, see subgraph.hpp */
+template <typename vid_t, typename proc_t>
+edgepart_writer<vid_t, proc_t> *
+new_subgraph_writer(edgepart_writer<vid_t, proc_t> *writer,
+                    const std::string &basefilename, int num_partitions,
+                    size_t block_size);
+
+template <typename vid_t, typename proc_t>
+edgepart_writer<vid_t, proc_t> *
+new_edgepart_writer(const std::string &basefilename, int num_partitions)
+{
+    CHECK_LE((size_t)num_partitions,
+             (size_t)std::numeric_limits<proc_t>::max() + 1)
+        << "partition ids of " << sizeof(proc_t) << " bytes";
+    size_t block_size = FLAGS_write_blocksize * 1024 * 1024;
+    // per-partition files share the memory of one writer, with a floor
+    size_t shard_block_size =
+        std::max((size_t)256 * 1024, block_size / num_partitions);
+    edgepart_writer<vid_t, proc_t> *writer;
+    if (!FLAGS_output_shards)
+        writer = new_edgepart_file_writer<vid_t, proc_t>(
+            partitioned_name(basefilename), num_partitions, -1, block_size);
+    else
+        writer = new sharded_edgepart_writer<vid_t, proc_t>(
+            basefilename, num_partitions, shard_block_size);
+    if (FLAGS_output_subgraphs)
+        writer = new_subgraph_writer(writer, basefilename, num_partitions,
+                                     shard_block_size);
+    if (FLAGS_async_output)
+        writer = new async_edgepart_writer<vid_t, proc_t>(writer);
+    return writer;
+}
@@ -1,41 +1,101 @@
+#include <algorithm>
+#include <omp.h>
+
 #include "graph.hpp"
 
-void graph_t::build(const std::vector<edge_t> &edges)
+template <typename vid_t>
+void graph_t<vid_t>::build(const edge_t *edges, size_t n,
+                           mapped_array<edge_t> *scratch)
 {
-    if (edges.size() > nedges)
-        neighbors = (uint40_t *)realloc(neighbors, sizeof(uint40_t) * edges.size());
-    CHECK(neighbors) << "allocation failed";
-    nedges = edges.size();
-
-    std::vector<size_t> count(num_vertices, 0);
-    for (size_t i = 0; i < nedges; i++)
-        count[edges[i].first]++;
-
-    vdata[0] = adjlist_t(neighbors);
-    for (vid_t v = 1; v < num_vertices; v++) {
-        count[v] += count[v-1];
-        vdata[v] = adjlist_t(neighbors + count[v-1]);
+    CHECK_LT(n, MAX_GRAPH_EDGES) << "too many edges";
+    neighbor_t<vid_t> *adj = neighbors.allocate(2 * n);
+    nedges = n;
+    // the lists are walked in no particular order; reading ahead would only
+    // bring in pages that the window has no room for
+    if (window)
+        neighbors.advise(MADV_RANDOM);
+
+    // the passes read a file-backed edges array a window at a time
+    size_t chunk = window && scratch && scratch->file_backed()
+                       ? std::max((size_t)1, window / sizeof(edge_t))
+                       : std::max((size_t)1, n);
+
+    // a lone thread skips the atomics, which cost it more than the rest
+    int nthreads = omp_get_max_threads();
+    auto bump = [nthreads](uint64_t &count) {
+        return nthreads > 1 ? __sync_fetch_and_add(&count, 1) : count++;
+    };
+
+    std::vector<uint64_t> offsets(num_vertices + 1, 0);
+    for (size_t lo = 0; lo < nedges; lo += chunk) {
+        size_t hi = std::min(nedges, lo + chunk);
+#pragma omp parallel for
+        for (size_t i = lo; i < hi; i++) {
+            bump(offsets[edges[i].first + 1]);
+            bump(offsets[edges[i].second + 1]);
+        }
+        if (scratch)
+            scratch->trim();
     }
-    for (size_t i = 0; i < edges.size(); i++)
-        vdata[edges[i].first].push_back(i);
-}
+    prefix_sum(offsets);
+#pragma omp parallel for
+    for (vid_t v = 0; v < num_vertices; v++)
+        heads[v].offset = offsets[v];
 
-void graph_t::build_reverse(const std::vector<edge_t> &edges)
-{
-    if (edges.size() > nedges)
-        neighbors = (uint40_t *)realloc(neighbors, sizeof(uint40_t) * edges.size());
-    CHECK(neighbors) << "allocation failed";
-    nedges = edges.size();
-
-    std::vector<size_t> count(num_vertices, 0);
-    for (size_t i = 0; i < nedges; i++)
-        count[edges[i].second]++;
-
-    vdata[0] = adjlist_t(neighbors);
-    for (vid_t v = 1; v < num_vertices; v++) {
-        count[v] += count[v-1];
-        vdata[v] = adjlist_t(neighbors + count[v-1]);
+    // several threads fill a list in any order; sorting it by edge id gives
+    // the order of a sequential build, so that a partitioning can be
+    // reproduced
+    auto by_edge = [](const neighbor_t<vid_t> &a, const neighbor_t<vid_t> &b) {
+        return a.e < b.e || (a.e == b.e && a.out > b.out);
+    };
+
+    // the lists of a range of vertices at a time, as many as the window
+    // holds, so that the scattered writes stay on resident pages; a scratch
+    // file takes a pass over the edges per range
+    size_t total = offsets[num_vertices],
+           range = std::max((size_t)1, window / sizeof(neighbor_t<vid_t>));
+    for (vid_t lo = 0, hi; lo < num_vertices; lo = hi) {
+        size_t limit = window && total - offsets[lo] > range
+                           ? offsets[lo] + range
+                           : total;
+        hi = std::upper_bound(offsets.begin() + lo + 1, offsets.end(),
+                              limit) - offsets.begin() - 1;
+        hi = std::max(hi, (vid_t)(lo + 1));
+
+        // offsets[v] is now the next free slot of the list of v
+        for (size_t elo = 0; elo < nedges; elo += chunk) {
+            size_t ehi = std::min(nedges, elo + chunk);
+#pragma omp parallel for
+            for (size_t i = elo; i < ehi; i++) {
+                vid_t u = edges[i].first, v = edges[i].second;
+                if (u >= lo && u < hi) {
+                    neighbor_t<vid_t> &out = adj[bump(offsets[u])];
+                    out.v = v;
+                    out.e = i;
+                    out.out = true;
+                }
+                if (v >= lo && v < hi) {
+                    neighbor_t<vid_t> &in = adj[bump(offsets[v])];
+                    in.v = u;
+                    in.e = i;
+                    in.out = false;
+                }
+            }
+            if (scratch)
+                scratch->trim();
+        }
+
+#pragma omp parallel for schedule(dynamic, 1024)
+        for (vid_t v = lo; v < hi; v++) {
+            heads[v].len = offsets[v] - heads[v].offset;
+            neighbor_t<vid_t> *first = adj + heads[v].offset,
+                              *last = adj + offsets[v];
+            if (!std::is_sorted(first, last, by_edge))
+                std::sort(first, last, by_edge);
+        }
+        trim();
     }
-    for (size_t i = 0; i < edges.size(); i++)
-        vdata[edges[i].second].push_back(i);
 }
+
+template class graph_t<uint32_t>;
+template class graph_t<uint64_t>;
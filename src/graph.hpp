@@ -1,65 +1,155 @@
 #pragma once
 
 #include <vector>
+#include <atomic>
 #include <parallel/algorithm>
 
 #include "util.hpp"
+#include "mapped_array.hpp"
 
 struct uint40_t {
         uint64_t v:40;
 } __attribute__((packed));
 
+/*
+ * An entry of an adjacency list: the neighbor itself next to the id of the
+ * edge leading to it, so that visiting a neighbor needs no lookup in the
+ * edge array, and the direction of the edge. Edges are removed through
+ * their ids, in a bitset shared by the lists of both ends.
+ */
+template <typename vid_t>
+struct neighbor_t {
+    vid_t v;
+    uint64_t e : 39;
+    uint64_t out : 1; // the edge goes from the owner of the list to v
+} __attribute__((packed));
+
+const size_t MAX_GRAPH_EDGES = (size_t)1 << 39;
+
+/* Where the neighbors of a vertex start and how many of them are left */
+template <typename vid_t>
+struct adjhead_t {
+    uint64_t offset : 40;
+    vid_t len;
+} __attribute__((packed));
+
+/* The neighbors of a vertex; a view on the storage of its graph_t */
+template <typename vid_t>
 class adjlist_t
 {
   private:
-    uint40_t *adj;
-    vid_t len;
+    neighbor_t<vid_t> *adj;
+    adjhead_t<vid_t> *head;
 
   public:
-    adjlist_t() : adj(NULL), len(0) {}
-    adjlist_t(uint40_t *adj, vid_t len = 0) : adj(adj), len(len) {}
-    uint40_t *begin() { return adj; }
-    uint40_t *end() { return adj + len; }
-    void increment() { len++; }
-    void push_back(size_t data) { adj[len++].v = data; }
-    size_t size() const { return len; }
-    uint40_t &operator[](size_t idx) { return adj[idx]; };
-    const uint40_t &operator[](size_t idx) const { return adj[idx]; };
-    uint40_t &back() { return adj[len - 1]; };
-    const uint40_t &back() const { return adj[len - 1]; };
-    void pop_back() { len--; }
-    void clear() { len = 0; }
+    adjlist_t(neighbor_t<vid_t> *neighbors, adjhead_t<vid_t> *head)
+        : adj(neighbors + head->offset), head(head)
+    {
+    }
+    neighbor_t<vid_t> *begin() { return adj; }
+    neighbor_t<vid_t> *end() { return adj + head->len; }
+    void push_back(vid_t v, size_t e, bool out)
+    {
+        adj[head->len].v = v;
+        adj[head->len].e = e;
+        adj[head->len].out = out;
+        head->len++;
+    }
+    size_t size() const { return head->len; }
+    neighbor_t<vid_t> &operator[](size_t idx) { return adj[idx]; };
+    const neighbor_t<vid_t> &operator[](size_t idx) const { return adj[idx]; };
+    neighbor_t<vid_t> &back() { return adj[head->len - 1]; };
+    const neighbor_t<vid_t> &back() const { return adj[head->len - 1]; };
+    void pop_back() { head->len--; }
+    void clear() { head->len = 0; }
 };
 
+/*
+ * Undirected view of a list of edges, as a single CSR: every edge is listed
+ * at both of its ends, so that a neighborhood is one list and is walked
+ * once. The lists are kept in memory, or in a scratch file paged by the
+ * kernel (use_file), for graphs larger than memory.
+ */
+template <typename vid_t>
 class graph_t
 {
+  public:
+    typedef basic_edge_t<vid_t> edge_t;
+    typedef adjlist_t<vid_t> adjlist_type;
+
   private:
     vid_t num_vertices;
     size_t nedges;
-    uint40_t *neighbors;
-    std::vector<adjlist_t> vdata;
+    mapped_array<neighbor_t<vid_t>> neighbors;
+    std::vector<adjhead_t<vid_t>> heads;
+    // bytes of lists to keep resident, 0: all of them, and those walked
+    // since the last trim
+    size_t window;
+    std::atomic<size_t> touched;
 
-  public:
-    graph_t() : num_vertices(0), nedges(0), neighbors(NULL) {}
+    // a read fault maps the cached pages around it as well, up to
+    // fault_around_bytes (64 KB by default)
+    static const size_t FAULT_AROUND = 64 * 1024;
 
-    ~graph_t()
-    {
-        if (neighbors)
-            free(neighbors);
-    }
+    void build(const edge_t *edges, size_t n, mapped_array<edge_t> *scratch);
+
+  public:
+    graph_t() : num_vertices(0), nedges(0), window(0), touched(0) {}
 
     void resize(vid_t _num_vertices)
     {
         num_vertices = _num_vertices;
-        vdata.resize(num_vertices);
+        heads.resize(num_vertices);
     }
 
     size_t num_edges() const { return nedges; }
 
-    void build(const std::vector<edge_t> &edges);
+    /* Keeps the lists in a scratch file at filename, of which about
+     * window_bytes are resident at a time */
+    void use_file(const std::string &filename, size_t window_bytes)
+    {
+        neighbors.use_file(filename);
+        window = std::max((size_t)1, window_bytes);
+    }
+
+    /* Lets the kernel take back the resident pages of a scratch file */
+    void trim()
+    {
+        neighbors.trim();
+        touched = 0;
+    }
+
+    /* Accounts for a walk over the list of v, charged with the pages it
+     * spans and those faulted in around them, and trims once a window of
+     * lists was walked; safe to call from several threads */
+    void touch(size_t v)
+    {
+        if (!window)
+            return;
+        size_t begin = heads[v].offset * sizeof(neighbor_t<vid_t>),
+               end = begin + heads[v].len * sizeof(neighbor_t<vid_t>);
+        size_t bytes = (end + 4095) / 4096 * 4096 - begin / 4096 * 4096 +
+                       FAULT_AROUND;
+        if (touched.fetch_add(bytes) + bytes > window)
+            trim();
+    }
 
-    void build_reverse(const std::vector<edge_t> &edges);
+    /* Lists edges[i] at its source and at its target, with id i */
+    void build(const edge_t *edges, size_t n) { build(edges, n, NULL); }
 
-    adjlist_t &operator[](size_t idx) { return vdata[idx]; };
-    const adjlist_t &operator[](size_t idx) const { return vdata[idx]; };
+    /* As build, trimming the pages of a file-backed edges array as it goes */
+    void build(mapped_array<edge_t> &edges, size_t n)
+    {
+        build(edges.data(), n, &edges);
+    }
+
+    void build(const std::vector<edge_t> &edges)
+    {
+        build(edges.data(), edges.size());
+    }
+
+    adjlist_type operator[](size_t idx)
+    {
+        return adjlist_type(neighbors.data(), &heads[idx]);
+    }
 };
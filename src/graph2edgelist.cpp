@@ -11,20 +11,35 @@ DEFINE_uint64(memsize, 4096, "memory size in megabytes");
 DEFINE_string(filename, "", "the file name of the input graph");
 DEFINE_string(filetype, "edgelist",
               "the type of input file (supports 'edgelist' and 'adjlist')");
+DEFINE_string(relabel, "parallel",
+              "vertex id relabeling during conversion: 'parallel' (two-pass) "
+              "or 'hash' (single pass)");
+DEFINE_uint64(write_blocksize, 16, "block size of buffered output in megabytes");
+DEFINE_bool(async_write, true, "flush output blocks on a background thread");
+DEFINE_bool(compress, false,
+            "store converted edge lists in the compressed block format");
+DEFINE_bool(verify_cache, false,
+            "check the content hashes of cached files before reusing them");
 
-class Graph2Edgelist : public Converter
+// raw ids are written back as they are, so they are read at full width
+class Graph2Edgelist : public Converter<uint64_t>
 {
   private:
     std::ofstream fout;
 
   public:
     Graph2Edgelist(std::string basefilename)
-        : Converter(basefilename)
+        : Converter<uint64_t>(basefilename)
     {
     }
     bool done() { return is_exists(basefilename + ".edgelist"); }
     void init() { fout.open(basefilename + ".edgelist"); }
-    void add_edge(vid_t from, vid_t to) { fout << from << ' ' << to << '\n'; }
+    void add_edge(uint64_t from, uint64_t to) { fout << from << ' ' << to << '\n'; }
+    void add_edges(const edge_t *edges, size_t n)
+    {
+        for (size_t i = 0; i < n; i++)
+            add_edge(edges[i].first, edges[i].second);
+    }
     void finalize() { fout.close(); }
 };
 
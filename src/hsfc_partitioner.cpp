@@ -7,43 +7,31 @@
 #include "sort.hpp"
 #include "conversions.hpp"
 
-HsfcPartitioner::HsfcPartitioner(std::string basefilename)
-    : basefilename(basefilename)
+template <typename vid_t>
+HsfcPartitioner<vid_t>::HsfcPartitioner(std::string basefilename)
+    : basefilename(basefilename), rd(), gen(rd()),
+      writer(new_edgepart_writer<vid_t, uint16_t>(basefilename, FLAGS_p))
 {
     Timer convert_timer;
     convert_timer.start();
-    convert(basefilename, new Converter(basefilename));
+    convert(basefilename, new Converter<vid_t>(basefilename));
     convert_timer.stop();
     LOG(INFO) << "convert time: " << convert_timer.get_time();
 
     total_time.start();
     LOG(INFO) << "initializing partitioner";
 
-    fin = open(binedgelist_name(basefilename).c_str(), O_RDONLY, (mode_t)0600);
-    PCHECK(fin != -1) << "Error opening file for read";
-    struct stat fileInfo = {0};
-    PCHECK(fstat(fin, &fileInfo) != -1) << "Error getting the file size";
-    PCHECK(fileInfo.st_size != 0) << "Error: file is empty";
-    LOG(INFO) << "file size: " << fileInfo.st_size;
-
-    fin_map = (char *)mmap(0, fileInfo.st_size, PROT_READ, MAP_SHARED, fin, 0);
-    if (fin_map == MAP_FAILED) {
-        close(fin);
-        PLOG(FATAL) << "error mapping the file";
-    }
-
-    filesize = fileInfo.st_size;
-    fin_ptr = fin_map;
-    fin_end = fin_map + filesize;
-
-    num_vertices = *(vid_t *)fin_ptr;
-    fin_ptr += sizeof(vid_t);
-    num_edges = *(size_t *)fin_ptr;
-    fin_ptr += sizeof(size_t);
+    stream.open(FLAGS_compress ? cbinedgelist_name(basefilename)
+                               : binedgelist_name(basefilename));
+    num_vertices = stream.num_vertices();
+    num_edges = stream.num_edges();
 
     LOG(INFO) << "num_vertices: " << num_vertices
               << ", num_edges: " << num_edges;
 
+    // the curve distance of an n x n grid has to fit into 64 bits
+    CHECK_LE(num_vertices, (uint64_t)1 << 32)
+        << "hsfc supports at most 2^32 vertices";
     n = 1;
     while (n < num_vertices)
         n = n << 1;
@@ -51,7 +39,8 @@ HsfcPartitioner::HsfcPartitioner(std::string basefilename)
     p = FLAGS_p;
 }
 
-void HsfcPartitioner::generate_hilber()
+template <typename vid_t>
+void HsfcPartitioner<vid_t>::generate_hilber()
 {
     Timer timer;
     timer.start();
@@ -59,24 +48,25 @@ void HsfcPartitioner::generate_hilber()
     std::ofstream fout(hilbert_name(basefilename), std::ios::binary);
     int gb = 0;
     size_t bytes = 0;
-    while (fin_ptr < fin_end) {
-        edge_t *e = (edge_t *)fin_ptr;
-        fin_ptr += sizeof(edge_t);
-        bytes += sizeof(edge_t);
-        vid_t u = e->first, v = e->second;
-        uint64_t d = xy2d(u, v);
-        fout.write((char *)&d, sizeof(d));
-        if (bytes == 1024*1024*1024) {
-            gb++;
-            bytes = 0;
+    const edge_t *edges;
+    while (size_t n = stream.next(edges))
+        for (size_t i = 0; i < n; i++) {
+            bytes += sizeof(edge_t);
+            vid_t u = edges[i].first, v = edges[i].second;
+            uint64_t d = xy2d(u, v);
+            fout.write((char *)&d, sizeof(d));
+            if (bytes == 1024*1024*1024) {
+                gb++;
+                bytes = 0;
+            }
         }
-    }
     fout.close();
     timer.stop();
     LOG(INFO) << "load time: " << timer.get_time();
 }
 
-void HsfcPartitioner::split()
+template <typename vid_t>
+void HsfcPartitioner<vid_t>::split()
 {
     std::vector<dense_bitset> is_mirrors(p, dense_bitset(num_vertices));
     std::vector<size_t> counter(p, 0);
@@ -85,11 +75,7 @@ void HsfcPartitioner::split()
         generate_hilber();
     else
         LOG(INFO) << "skip generating hilbert distance file";
-    if (munmap(fin_map, filesize) == -1) {
-        close(fin);
-        PLOG(FATAL) << "Error un-mmapping the file";
-    }
-    close(fin);
+    stream.close();
 
     Timer timer;
     if (!is_exists(sorted_hilbert_name(basefilename))) {
@@ -114,18 +100,38 @@ void HsfcPartitioner::split()
     timer.reset();
     timer.start();
     LOG(INFO) << "partitioning...";
-    std::ifstream hilbert_file(sorted_hilbert_name(basefilename), std::ios::binary);
+    int fd = open(sorted_hilbert_name(basefilename).c_str(), O_RDONLY);
+    PCHECK(fd != -1) << "Error opening `" << sorted_hilbert_name(basefilename)
+                     << "' for read";
     size_t range = num_edges / p + 1;
-    for (size_t i = 0; i < num_edges; i++) {
-        int bucket = i / range;
-        counter[bucket]++;
-        vid_t u, v;
-        uint64_t d;
-        hilbert_file.read((char *)&d, sizeof(d));
-        d2xy(d, &u, &v);
-        is_mirrors[bucket].set_bit_unsync(u);
-        is_mirrors[bucket].set_bit_unsync(v);
+    size_t batch_size = std::max(
+        (size_t)1, FLAGS_read_blocksize * 1024 * 1024 / sizeof(uint64_t));
+    std::vector<uint64_t> distances(std::min(batch_size, num_edges));
+    std::vector<edge_t> edges(distances.size());
+    std::vector<uint16_t> buckets(distances.size());
+    for (size_t first = 0; first < num_edges; first += batch_size) {
+        size_t n = std::min(batch_size, num_edges - first);
+        preada(fd, (char *)&distances[0], n * sizeof(uint64_t),
+               first * sizeof(uint64_t));
+#pragma omp parallel for
+        for (size_t i = 0; i < n; i++) {
+            int bucket = (first + i) / range;
+            buckets[i] = bucket;
+            d2xy(distances[i], &edges[i].first, &edges[i].second);
+            mark_mirror(is_mirrors[bucket], edges[i].first);
+            mark_mirror(is_mirrors[bucket], edges[i].second);
+        }
+        for (size_t i = 0; i < n; i++)
+            counter[buckets[i]]++;
+        writer->save_edges(&edges[0], &buckets[0], n);
     }
+    close(fd);
+    std::vector<uint16_t> master;
+    assign_master(is_mirrors, num_vertices, gen, *writer, master);
+    if (FLAGS_output_replicas)
+        save_replica_map<vid_t>(replicas_name(basefilename), is_mirrors,
+                                    master);
+    writer->close();
     timer.stop();
     LOG(INFO) << "partition time: " << timer.get_time();
 
@@ -140,3 +146,6 @@ void HsfcPartitioner::split()
     total_time.stop();
     LOG(INFO) << "total partition time: " << total_time.get_time();
 }
+
+template class HsfcPartitioner<uint32_t>;
+template class HsfcPartitioner<uint64_t>;
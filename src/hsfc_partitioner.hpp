@@ -5,20 +5,21 @@
 #include <iostream>
 #include <fstream>
 #include <random>
-#include <fcntl.h>
-#include <sys/stat.h>
-#include <sys/mman.h>
-#include <unistd.h>
+#include <memory>
 #include <parallel/algorithm>
 
 #include "util.hpp"
 #include "dense_bitset.hpp"
 #include "edgepart.hpp"
 #include "partitioner.hpp"
+#include "edge_stream.hpp"
 
+template <typename vid_t>
 class HsfcPartitioner : public Partitioner
 {
   private:
+    typedef basic_edge_t<vid_t> edge_t;
+
     const size_t BUFFER_SIZE = 64 * 1024 / sizeof(edge_t);
     std::string basefilename;
 
@@ -26,15 +27,16 @@ class HsfcPartitioner : public Partitioner
     size_t num_edges;
     int p;
 
-    // use mmap for file input
-    int fin;
-    off_t filesize;
-    char *fin_map, *fin_ptr, *fin_end;
+    edge_stream<vid_t> stream;
+
+    std::random_device rd;
+    std::mt19937 gen;
+    std::unique_ptr<edgepart_writer<vid_t, uint16_t>> writer;
 
     uint64_t n;
 
     // convert (x,y) to d
-    uint64_t xy2d(uint32_t x, uint32_t y)
+    uint64_t xy2d(vid_t x, vid_t y)
     {
         uint64_t rx, ry, s, d = 0;
         for (s = n / 2; s > 0; s /= 2) {
@@ -47,7 +49,7 @@ class HsfcPartitioner : public Partitioner
     }
 
     // convert d to (x,y)
-    void d2xy(uint64_t d, uint32_t *x, uint32_t *y)
+    void d2xy(uint64_t d, vid_t *x, vid_t *y)
     {
         uint64_t rx, ry, s, t = d;
         *x = *y = 0;
@@ -62,7 +64,7 @@ class HsfcPartitioner : public Partitioner
     }
 
     // rotate/flip a quadrant appropriately
-    void rot(uint64_t n, uint32_t *x, uint32_t *y, uint64_t rx, uint64_t ry)
+    void rot(uint64_t n, vid_t *x, vid_t *y, uint64_t rx, uint64_t ry)
     {
         if (ry == 0) {
             if (rx == 1) {
@@ -71,7 +73,7 @@ class HsfcPartitioner : public Partitioner
             }
 
             // Swap x and y
-            uint32_t t = *x;
+            vid_t t = *x;
             *x = *y;
             *y = t;
         }
@@ -15,11 +15,80 @@ DEFINE_uint64(memsize, 4096, "memory size in megabytes");
 DEFINE_string(filename, "", "the file name of the input graph");
 DEFINE_string(filetype, "edgelist",
               "the type of input file (supports 'edgelist' and 'adjlist')");
+DEFINE_string(relabel, "parallel",
+              "vertex id relabeling during conversion: 'parallel' (two-pass) "
+              "or 'hash' (single pass)");
+DEFINE_uint64(write_blocksize, 16, "block size of buffered output in megabytes");
+DEFINE_bool(async_write, true, "flush output blocks on a background thread");
+DEFINE_string(output_format, "text",
+              "format of the partition file: 'text' (escaped lines) or "
+              "'binary' (fixed-size records)");
+DEFINE_bool(output_index, false,
+            "group the records of the binary partition file by partition and "
+            "index them");
+DEFINE_bool(output_shards, false,
+            "write the partition file as one shard per partition");
+DEFINE_bool(output_replicas, false,
+            "also write the partitions of every vertex and its master in CSR "
+            "form");
+DEFINE_bool(output_subgraphs, false,
+            "also write a local CSR subgraph of every partition");
+DEFINE_bool(subgraph_in_edges, false,
+            "add the in-edges to the local subgraphs");
+DEFINE_bool(async_output, true,
+            "format and write the partition output on a separate thread");
+DEFINE_string(input_backend, "mmap",
+              "how partitioners read edge lists: 'mmap' or 'pread'");
+DEFINE_uint64(read_blocksize, 16, "batch size of edge list input in megabytes");
+DEFINE_bool(compress, false,
+            "store converted edge lists in the compressed block format");
+DEFINE_bool(verify_cache, false,
+            "check the content hashes of cached files before reusing them");
+DEFINE_bool(vid64, false,
+            "use 64-bit vertex ids, for graphs with more than 2^32 vertices");
+DEFINE_int32(shuffle_threads, 0,
+             "number of threads shuffling chunks when the edge list does not "
+             "fit in memory (0: all cores)");
 DEFINE_bool(inmem, false, "in-memory mode");
+DEFINE_int32(ne_threads, 1,
+             "number of partitions NE grows at once, each on its own thread "
+             "with its own heap (1: sequential)");
+DEFINE_string(ne_storage, "memory",
+              "where NE keeps its edges and adjacency lists: 'memory', 'file' "
+              "(scratch files next to the input, paged within -memsize) or "
+              "'auto' (files if memory would exceed -memsize)");
+DEFINE_string(priority_queue, "heap",
+              "vertex queue of NE and SNE: 'heap' (binary heap) or 'bucket' "
+              "(bucket queue, O(1) updates)");
 DEFINE_double(sample_ratio, 2, "the sample size divided by num_vertices");
 DEFINE_string(method, "sne",
               "partition method: ne, sne, random, and dbh");
 
+template <typename vid_t>
+Partitioner *new_partitioner(const std::string &method)
+{
+    typedef BucketQueue<vid_t, vid_t> bucket_queue_t;
+    CHECK(FLAGS_priority_queue == "heap" || FLAGS_priority_queue == "bucket")
+        << "unknown priority queue: " << FLAGS_priority_queue;
+    bool buckets = FLAGS_priority_queue == "bucket";
+    if (method == "ne" && buckets)
+        return new NePartitioner<vid_t, bucket_queue_t>(FLAGS_filename);
+    else if (method == "ne")
+        return new NePartitioner<vid_t>(FLAGS_filename);
+    else if (method == "sne" && buckets)
+        return new SnePartitioner<vid_t, bucket_queue_t>(FLAGS_filename);
+    else if (method == "sne")
+        return new SnePartitioner<vid_t>(FLAGS_filename);
+    else if (method == "random")
+        return new RandomPartitioner<vid_t>(FLAGS_filename);
+    else if (method == "dbh")
+        return new DbhPartitioner<vid_t>(FLAGS_filename);
+    else if (method == "hsfc")
+        return new HsfcPartitioner<vid_t>(FLAGS_filename);
+    LOG(ERROR) << "unkown method: " << method;
+    return NULL;
+}
+
 int main(int argc, char *argv[])
 {
     std::string usage = "-filename <path to the input graph> "
@@ -39,20 +108,11 @@ int main(int argc, char *argv[])
     Timer timer;
     timer.start();
 
-    Partitioner *partitioner = NULL;
-    if (FLAGS_method == "ne")
-        partitioner = new NePartitioner(FLAGS_filename);
-    else if (FLAGS_method == "sne")
-        partitioner = new SnePartitioner(FLAGS_filename);
-    else if (FLAGS_method == "random")
-        partitioner = new RandomPartitioner(FLAGS_filename);
-    else if (FLAGS_method == "dbh")
-        partitioner = new DbhPartitioner(FLAGS_filename);
-    else if (FLAGS_method == "hsfc")
-        partitioner = new HsfcPartitioner(FLAGS_filename);
-    else
-        LOG(ERROR) << "unkown method: " << FLAGS_method;
-    LOG(INFO) << "partition method: " << FLAGS_method;
+    Partitioner *partitioner =
+        FLAGS_vid64 ? new_partitioner<uint64_t>(FLAGS_method)
+                    : new_partitioner<uint32_t>(FLAGS_method);
+    LOG(INFO) << "partition method: " << FLAGS_method
+              << ", vertex id width: " << (FLAGS_vid64 ? 64 : 32);
     partitioner->split();
 
     timer.stop();
@@ -0,0 +1,194 @@
+#include <cstring>
+#include <fstream>
+#include <map>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+#include <unistd.h>
+#include <omp.h>
+
+#include "manifest.hpp"
+
+namespace
+{
+
+const char MANIFEST_MAGIC[] = "edgepart-manifest";
+const char MANIFEST_END[] = "complete";
+const size_t HASH_BLOCK = 4 << 20;
+
+inline uint64_t mix64(uint64_t x)
+{
+    x ^= x >> 30;
+    x *= 0xbf58476d1ce4e5b9ULL;
+    x ^= x >> 27;
+    x *= 0x94d049bb133111ebULL;
+    x ^= x >> 31;
+    return x;
+}
+
+uint64_t hash_block(const char *p, size_t n)
+{
+    uint64_t h = mix64(n);
+    size_t i = 0;
+    for (; i + 8 <= n; i += 8) {
+        uint64_t w;
+        memcpy(&w, p + i, 8);
+        h ^= w;
+        h *= 0x9e3779b97f4a7c15ULL;
+        h ^= h >> 32;
+    }
+    for (; i < n; i++)
+        h = (h ^ (uint8_t)p[i]) * 0x100000001b3ULL;
+    return mix64(h);
+}
+
+std::string source_mtime(const struct stat &st)
+{
+    std::stringstream ss;
+    ss << st.st_mtim.tv_sec << "." << st.st_mtim.tv_nsec;
+    return ss.str();
+}
+
+void sync_file(const std::string &name)
+{
+    int fd = open(name.c_str(), O_RDONLY);
+    PCHECK(fd != -1) << "Error opening `" << name << "' for sync";
+    PCHECK(fsync(fd) != -1) << "Error syncing `" << name << "'";
+    close(fd);
+}
+
+} // namespace
+
+uint64_t hash_file(const std::string &filename)
+{
+    int fd = open(filename.c_str(), O_RDONLY);
+    PCHECK(fd != -1) << "Error opening `" << filename << "' for read";
+    struct stat fileInfo = {0};
+    PCHECK(fstat(fd, &fileInfo) != -1) << "Error getting the file size";
+    size_t filesize = fileInfo.st_size;
+    if (filesize == 0) {
+        close(fd);
+        return mix64(0);
+    }
+    char *map = (char *)mmap(0, filesize, PROT_READ, MAP_SHARED, fd, 0);
+    if (map == MAP_FAILED) {
+        close(fd);
+        PLOG(FATAL) << "error mapping the file";
+    }
+    madvise(map, filesize, MADV_SEQUENTIAL);
+
+    // hash the blocks in parallel and chain the block hashes in order
+    size_t nblocks = (filesize + HASH_BLOCK - 1) / HASH_BLOCK;
+    std::vector<uint64_t> hashes(nblocks);
+#pragma omp parallel for schedule(dynamic)
+    for (size_t b = 0; b < nblocks; b++)
+        hashes[b] = hash_block(map + b * HASH_BLOCK,
+                               std::min(HASH_BLOCK, filesize - b * HASH_BLOCK));
+    uint64_t h = mix64(filesize);
+    for (uint64_t x : hashes)
+        h = mix64(h ^ x);
+
+    munmap(map, filesize);
+    close(fd);
+    return h;
+}
+
+bool cache_manifest::valid(bool verify) const
+{
+    std::ifstream fin(filename);
+    if (!fin)
+        return false;
+    std::string magic, key, value;
+    int version;
+    fin >> magic >> version;
+    if (magic != MANIFEST_MAGIC || version != CACHE_FORMAT_VERSION) {
+        LOG(INFO) << "`" << filename << "' has an unknown format";
+        return false;
+    }
+
+    std::map<std::string, std::string> recorded;
+    std::map<std::string, std::pair<size_t, uint64_t>> files;
+    bool complete = false;
+    while (fin >> key) {
+        if (key == MANIFEST_END) {
+            complete = true;
+            break;
+        }
+        if (key == "file") {
+            size_t size;
+            uint64_t hash;
+            fin >> size >> std::hex >> hash >> std::dec;
+            std::getline(fin >> std::ws, value);
+            files[value] = std::make_pair(size, hash);
+        } else {
+            std::getline(fin >> std::ws, value);
+            recorded[key] = value;
+        }
+    }
+    if (!complete) {
+        LOG(INFO) << "`" << filename << "' is incomplete";
+        return false;
+    }
+
+    struct stat st;
+    if (stat(source.c_str(), &st) != 0) {
+        LOG(INFO) << "cannot stat `" << source << "'";
+        return false;
+    }
+    std::vector<std::pair<std::string, std::string>> expected = settings;
+    expected.push_back(std::make_pair("source", source));
+    expected.push_back(std::make_pair("source_size", std::to_string(st.st_size)));
+    expected.push_back(std::make_pair("source_mtime", source_mtime(st)));
+    for (auto &kv : expected)
+        if (recorded[kv.first] != kv.second) {
+            LOG(INFO) << "cache is stale: " << kv.first << " was `"
+                      << recorded[kv.first] << "', now `" << kv.second << "'";
+            return false;
+        }
+
+    for (auto &output : outputs) {
+        auto it = files.find(output);
+        if (it == files.end() || !is_exists(output) ||
+            file_size(output) != it->second.first) {
+            LOG(INFO) << "cache file `" << output << "' is missing or truncated";
+            return false;
+        }
+        if (verify && hash_file(output) != it->second.second) {
+            LOG(INFO) << "cache file `" << output << "' is corrupted";
+            return false;
+        }
+    }
+    return true;
+}
+
+void cache_manifest::invalidate() const { remove(filename.c_str()); }
+
+void cache_manifest::commit() const
+{
+    struct stat st;
+    PCHECK(stat(source.c_str(), &st) == 0) << "cannot stat `" << source << "'";
+
+    std::stringstream ss;
+    ss << MANIFEST_MAGIC << " " << CACHE_FORMAT_VERSION << "\n";
+    for (auto &kv : settings)
+        ss << kv.first << " " << kv.second << "\n";
+    ss << "source " << source << "\n";
+    ss << "source_size " << st.st_size << "\n";
+    ss << "source_mtime " << source_mtime(st) << "\n";
+    for (auto &output : outputs) {
+        sync_file(output);
+        ss << "file " << file_size(output) << " " << std::hex
+           << hash_file(output) << std::dec << " " << output << "\n";
+    }
+    ss << MANIFEST_END << "\n";
+
+    std::string tmp = filename + ".tmp", content = ss.str();
+    int fd = open(tmp.c_str(), O_WRONLY | O_CREAT | O_TRUNC,
+                  S_IRUSR | S_IWUSR | S_IRGRP | S_IROTH);
+    PCHECK(fd != -1) << "Error opening `" << tmp << "' for write";
+    writea(fd, (char *)content.data(), content.size());
+    PCHECK(fsync(fd) != -1) << "Error syncing `" << tmp << "'";
+    close(fd);
+    PCHECK(rename(tmp.c_str(), filename.c_str()) == 0)
+        << "Error renaming `" << tmp << "'";
+}
@@ -0,0 +1,56 @@
+#pragma once
+
+#include <string>
+#include <vector>
+#include <utility>
+
+#include "util.hpp"
+
+DECLARE_bool(verify_cache);
+
+/* Bump whenever the layout of a cached file changes */
+const int CACHE_FORMAT_VERSION = 1;
+
+/* Parallel 64-bit content hash of a file (not cryptographic) */
+uint64_t hash_file(const std::string &filename);
+
+/*
+ * Manifest of a set of cache files derived from an input graph. It records
+ * the format version, the settings that shape the files, the size and mtime
+ * of the input and the size and content hash of every file, and ends with a
+ * completion marker. It is removed before the files are rebuilt and written
+ * (atomically) only after all of them are complete, so a crashed or
+ * outdated conversion never looks valid.
+ */
+class cache_manifest
+{
+  private:
+    std::string filename, source;
+    std::vector<std::pair<std::string, std::string>> settings;
+    std::vector<std::string> outputs;
+
+  public:
+    cache_manifest(const std::string &filename, const std::string &source)
+        : filename(filename), source(source)
+    {
+    }
+
+    template <typename T>
+    void set(const std::string &key, const T &value)
+    {
+        std::stringstream ss;
+        ss << value;
+        settings.push_back(std::make_pair(key, ss.str()));
+    }
+
+    void add_output(const std::string &output) { outputs.push_back(output); }
+
+    /* Checks the manifest on disk against the current input, settings and
+     * files; the content hashes are compared only if verify is set */
+    bool valid(bool verify) const;
+
+    void invalidate() const;
+
+    /* Syncs and hashes the files and writes the manifest */
+    void commit() const;
+};
@@ -0,0 +1,92 @@
+#pragma once
+
+#include <string>
+#include <string.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+#include "util.hpp"
+
+/*
+ * Array of plain elements in pages of its own: anonymous memory, or a
+ * scratch file mapped in shared mode once use_file() is called, so that the
+ * kernel writes cold pages back to the file instead of the process running
+ * out of memory. The file is unlinked as soon as it is mapped, so nothing is
+ * left behind. The contents are not kept when the array grows.
+ */
+template <typename T>
+class mapped_array
+{
+  private:
+    T *base;
+    size_t length;
+    std::string scratch; // the backing file, if any
+
+    void unmap()
+    {
+        if (base)
+            munmap(base, length * sizeof(T));
+        base = NULL;
+        length = 0;
+    }
+
+  public:
+    mapped_array() : base(NULL), length(0) {}
+    mapped_array(const mapped_array &) = delete;
+    mapped_array &operator=(const mapped_array &) = delete;
+    ~mapped_array() { unmap(); }
+
+    /* Backs the array with a file at filename from the next allocation */
+    void use_file(const std::string &filename) { scratch = filename; }
+
+    bool file_backed() const { return !scratch.empty(); }
+
+    /* Makes room for n elements */
+    T *allocate(size_t n)
+    {
+        if (n <= length)
+            return base;
+        unmap();
+        size_t bytes = n * sizeof(T);
+        void *map;
+        if (scratch.empty()) {
+            map = mmap(0, bytes, PROT_READ | PROT_WRITE,
+                       MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+        } else {
+            int fd = open(scratch.c_str(), O_RDWR | O_CREAT | O_TRUNC, 0600);
+            PCHECK(fd != -1) << "Error opening `" << scratch << "' for write";
+            // reserve the blocks now rather than die of SIGBUS later
+            int err = posix_fallocate(fd, 0, bytes);
+            CHECK_EQ(err, 0) << "Error allocating " << bytes << " bytes for `"
+                             << scratch << "': " << strerror(err);
+            map = mmap(0, bytes, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+            ::close(fd);
+            unlink(scratch.c_str());
+        }
+        PCHECK(map != MAP_FAILED) << "Error mapping " << bytes << " bytes";
+        base = (T *)map;
+        length = n;
+        return base;
+    }
+
+    /* Drops the pages of a file-backed array from the process; they are
+     * read back from the page cache or the file on the next access */
+    void trim()
+    {
+        if (base && file_backed())
+            madvise(base, length * sizeof(T), MADV_DONTNEED);
+    }
+
+    /* Tells the kernel how the array is accessed, see madvise(2) */
+    void advise(int advice)
+    {
+        if (base)
+            madvise(base, length * sizeof(T), advice);
+    }
+
+    void release() { unmap(); }
+
+    T *data() { return base; }
+    T &operator[](size_t i) { return base[i]; }
+};
@@ -0,0 +1,182 @@
+#pragma once
+
+#include <vector>
+#include <algorithm>
+#include <omp.h>
+
+#include "util.hpp"
+#include "dense_bitset.hpp"
+
+/*
+ * An entry of the membership: a partition id and whether the vertex is a
+ * core of that partition, a replica of it (boundary), or both.
+ */
+const uint16_t MEMBER_PARTITION = 0x3fff;
+const uint16_t MEMBER_BOUNDARY = 0x4000;
+const uint16_t MEMBER_CORE = 0x8000;
+const int MEMBER_MAX_PARTITIONS = MEMBER_PARTITION + 1;
+
+/*
+ * Partitions of every vertex, as a list of entries sorted by partition, so
+ * that memory and lookups follow the replication rather than the number of
+ * partitions. Up to three entries live in the head of the vertex; longer
+ * lists live in a pool, in slots of a power of two entries that double as
+ * they fill up.
+ */
+class membership
+{
+  private:
+    struct head_t {
+        uint16_t count;
+        uint16_t entries[3]; // or the 48-bit offset of the list in the pool
+    };
+
+    int p;
+    std::vector<head_t> heads;
+    std::vector<uint16_t> pool;
+
+    static size_t capacity(size_t n)
+    {
+        if (n <= 3)
+            return 3;
+        return size_t(1) << (64 - __builtin_clzl(n - 1));
+    }
+
+    static uint64_t offset(const head_t &h)
+    {
+        return h.entries[0] | (uint64_t)h.entries[1] << 16 |
+               (uint64_t)h.entries[2] << 32;
+    }
+
+    static void set_offset(head_t &h, uint64_t off)
+    {
+        h.entries[0] = off;
+        h.entries[1] = off >> 16;
+        h.entries[2] = off >> 32;
+    }
+
+  public:
+    membership() : p(0) {}
+
+    void resize(size_t num_vertices, int num_partitions)
+    {
+        CHECK_LE(num_partitions, MEMBER_MAX_PARTITIONS)
+            << "too many partitions";
+        p = num_partitions;
+        heads.assign(num_vertices, head_t());
+        pool.clear();
+    }
+
+    int num_partitions() const { return p; }
+
+    size_t size(size_t v) const { return heads[v].count; }
+
+    const uint16_t *entries(size_t v) const
+    {
+        const head_t &h = heads[v];
+        return h.count <= 3 ? h.entries : &pool[offset(h)];
+    }
+
+    /* Sets flags of v in partition, mostly appended as partitions are grown
+     * in increasing order; not thread-safe */
+    void add(size_t v, int partition, uint16_t flags)
+    {
+        head_t &h = heads[v];
+        size_t n = h.count, i = n;
+        uint16_t *a = n <= 3 ? h.entries : &pool[offset(h)];
+        while (i > 0 && (a[i - 1] & MEMBER_PARTITION) > partition)
+            i--;
+        if (i > 0 && (a[i - 1] & MEMBER_PARTITION) == partition) {
+            a[i - 1] |= flags;
+            return;
+        }
+        if (n == capacity(n)) {
+            uint64_t off = pool.size();
+            pool.resize(off + (n == 3 ? 4 : 2 * n));
+            a = n <= 3 ? h.entries : &pool[offset(h)];
+            std::copy(a, a + n, &pool[off]);
+            set_offset(h, off);
+            a = &pool[off];
+        }
+        std::copy_backward(a + i, a + n, a + n + 1);
+        a[i] = partition | flags;
+        h.count++;
+    }
+
+    /* Counts the entries with all of flags set */
+    size_t count(uint16_t flags) const
+    {
+        size_t result = 0;
+#pragma omp parallel for reduction(+ : result)
+        for (size_t v = 0; v < heads.size(); v++) {
+            const uint16_t *a = entries(v);
+            rep (i, size(v))
+                result += (a[i] & flags) == flags;
+        }
+        return result;
+    }
+};
+
+/*
+ * Core and boundary sets of the partition being grown, as bitsets for O(1)
+ * tests; the vertices in either are listed so that finish() moves them to
+ * the membership in time proportional to their number.
+ */
+template <typename vid_t>
+class dense_partition
+{
+  public:
+    dense_bitset is_core, is_boundary;
+    std::vector<vid_t> vertices;
+
+    void resize(size_t num_vertices)
+    {
+        is_core.resize(num_vertices);
+        is_core.clear();
+        is_boundary.resize(num_vertices);
+        is_boundary.clear();
+        vertices.clear();
+    }
+
+    void set_core(vid_t v)
+    {
+        if (!is_core.get(v) && !is_boundary.get(v))
+            vertices.push_back(v);
+        is_core.set_bit_unsync(v);
+    }
+
+    void set_boundary(vid_t v)
+    {
+        if (!is_core.get(v) && !is_boundary.get(v))
+            vertices.push_back(v);
+        is_boundary.set_bit_unsync(v);
+    }
+
+    void finish(membership &members, int partition)
+    {
+        for (vid_t v : vertices) {
+            uint16_t flags = (is_core.get(v) ? MEMBER_CORE : 0) |
+                             (is_boundary.get(v) ? MEMBER_BOUNDARY : 0);
+            if (flags)
+                members.add(v, partition, flags);
+            is_core.clear_bit_unsync(v);
+            is_boundary.clear_bit_unsync(v);
+        }
+        vertices.clear();
+    }
+
+    /* As finish, for the last partition, which takes the edges left over:
+     * its replicas are its cores unless they are cores elsewhere already */
+    void finish_last(membership &members, int partition)
+    {
+        for (vid_t v : vertices) {
+            const uint16_t *a = members.entries(v);
+            bool core = false;
+            rep (i, members.size(v))
+                core |= (a[i] & MEMBER_CORE) != 0;
+            if (!core)
+                set_core(v);
+        }
+        finish(members, partition);
+    }
+};
@@ -4,7 +4,7 @@
 
 #include "util.hpp"
 
-template<typename ValueType, typename KeyType, typename IdxType = vid_t>
+template<typename ValueType, typename KeyType, typename IdxType = KeyType>
 class MinHeap {
 private:
     IdxType n;
@@ -1,12 +1,15 @@
 #include "ne_partitioner.hpp"
 #include "conversions.hpp"
+#include "edge_stream.hpp"
 
-NePartitioner::NePartitioner(std::string basefilename)
-    : basefilename(basefilename), rd(), gen(rd()), writer(basefilename)
+template <typename vid_t, typename heap_t>
+NePartitioner<vid_t, heap_t>::NePartitioner(std::string basefilename)
+    : basefilename(basefilename), rd(), gen(rd()),
+      writer(new_edgepart_writer<vid_t, uint16_t>(basefilename, FLAGS_p))
 {
     Timer convert_timer;
     convert_timer.start();
-    Converter *converter = new Converter(basefilename);
+    Converter<vid_t> *converter = new Converter<vid_t>(basefilename);
     convert(basefilename, converter);
     delete converter;
     convert_timer.stop();
@@ -15,40 +18,58 @@ NePartitioner::NePartitioner(std::string basefilename)
     total_time.start();
     LOG(INFO) << "initializing partitioner";
 
-    std::ifstream fin(binedgelist_name(basefilename),
-                      std::ios::binary | std::ios::ate);
-    auto filesize = fin.tellg();
-    LOG(INFO) << "file size: " << filesize;
-    fin.seekg(0, std::ios::beg);
-
-    fin.read((char *)&num_vertices, sizeof(num_vertices));
-    fin.read((char *)&num_edges, sizeof(num_edges));
-
+    edge_stream<vid_t> stream;
+    stream.open(FLAGS_compress ? cbinedgelist_name(basefilename)
+                               : binedgelist_name(basefilename));
+    num_vertices = stream.num_vertices();
+    num_edges = stream.num_edges();
     LOG(INFO) << "num_vertices: " << num_vertices
               << ", num_edges: " << num_edges;
-    CHECK_EQ(sizeof(vid_t) + sizeof(size_t) + num_edges * sizeof(edge_t), filesize);
 
     p = FLAGS_p;
     average_degree = (double)num_edges * 2 / num_vertices;
     assigned_edges = 0;
     capacity = (double)num_edges * BALANCE_RATIO / p + 1;
     occupied.assign(p, 0);
-    adj_out.resize(num_vertices);
-    adj_in.resize(num_vertices);
-    is_cores.assign(p, dense_bitset(num_vertices));
-    is_boundarys.assign(p, dense_bitset(num_vertices));
-    master.assign(num_vertices, -1);
-    dis.param(std::uniform_int_distribution<vid_t>::param_type(0, num_vertices - 1));
+    adj.resize(num_vertices);
+    members.resize(num_vertices, p);
+    current.resize(num_vertices);
+
+    // the edges and the lists take almost all of the memory of NE
+    CHECK(FLAGS_ne_storage == "memory" || FLAGS_ne_storage == "file" ||
+          FLAGS_ne_storage == "auto")
+        << "unknown NE storage: " << FLAGS_ne_storage;
+    size_t memsize = FLAGS_memsize * 1024 * 1024,
+           needed = num_edges *
+                    (sizeof(edge_t) + 2 * sizeof(neighbor_t<vid_t>));
+    mapped_array<edge_t> edges;
+    if (FLAGS_ne_storage == "file" ||
+        (FLAGS_ne_storage == "auto" && needed > memsize)) {
+        LOG(INFO) << "edges and adjacency lists (" << needed / 1024 / 1024
+                  << " MB) go to scratch files, " << FLAGS_memsize / 2.0
+                  << " MB of lists resident at a time";
+        edges.use_file(scratch_name(basefilename, "edges"));
+        adj.use_file(scratch_name(basefilename, "adjlists"), memsize / 2);
+    }
 
     Timer read_timer;
     read_timer.start();
     LOG(INFO) << "loading...";
-    edges.resize(num_edges);
-    fin.read((char *)&edges[0], sizeof(edge_t) * num_edges);
+    edges.allocate(num_edges);
+    const edge_t *batch;
+    for (size_t i = 0, n; (n = stream.next(batch)); i += n) {
+        std::copy(batch, batch + n, &edges[i]);
+        edges.trim();
+    }
+    stream.close();
 
     LOG(INFO) << "constructing...";
-    adj_out.build(edges);
-    adj_in.build_reverse(edges);
+    adj.build(edges, num_edges);
+    edges.release();
+    removed_edges.resize(num_edges);
+    removed_edges.clear();
+    dirty.resize(num_vertices);
+    dirty.clear();
 
     degrees.resize(num_vertices);
     std::ifstream degree_file(degree_name(basefilename), std::ios::binary);
@@ -58,121 +79,182 @@ NePartitioner::NePartitioner(std::string basefilename)
     LOG(INFO) << "time used for graph input and construction: " << read_timer.get_time();
 };
 
-void NePartitioner::assign_remaining()
+template <typename vid_t, typename heap_t>
+void NePartitioner<vid_t, heap_t>::expand()
 {
-    auto &is_boundary = is_boundarys[p - 1], &is_core = is_cores[p - 1];
-    repv (u, num_vertices)
-        for (auto &i : adj_out[u])
-            if (edges[i.v].valid()) {
-                assign_edge(p - 1, u, edges[i.v].second);
-                is_boundary.set_bit_unsync(u);
-                is_boundary.set_bit_unsync(edges[i.v].second);
-            }
-
-    repv (i, num_vertices) {
-        if (is_boundary.get(i)) {
-            is_core.set_bit_unsync(i);
-            rep (j, p - 1)
-                if (is_cores[j].get(i)) {
-                    is_core.set_unsync(i, false);
+    min_heap.reserve(num_vertices);
+    seeds.build(adj, num_vertices, 2 * average_degree);
+    for (bucket = 0; bucket < p - 1; bucket++) {
+        std::cerr << bucket << ", ";
+        DLOG(INFO) << "sample size: " << adj.num_edges();
+        while (occupied[bucket] < capacity) {
+            vid_t d, vid;
+            if (!min_heap.get_min(d, vid)) {
+                if (!get_free_vertex(vid)) {
+                    DLOG(INFO) << "partition " << bucket
+                               << " stop: no free vertices";
                     break;
                 }
+                d = adj[vid].size();
+            } else {
+                min_heap.remove(vid);
+                /* CHECK_EQ(d, adj[vid].size()); */
+            }
+
+            occupy_vertex(vid, d);
         }
+        min_heap.clear();
+        compact_adjlists(dirty_vertices);
+        adj.trim();
+        current.finish(members, bucket);
+        seeds.refresh();
     }
 }
 
-void NePartitioner::assign_master()
+/* Grows the first p - 1 partitions -ne_threads at a time */
+template <typename vid_t, typename heap_t>
+void NePartitioner<vid_t, heap_t>::expand_parallel()
 {
-    std::vector<vid_t> count_master(p, 0);
-    std::vector<vid_t> quota(p, num_vertices);
-    long long sum = p * num_vertices;
-    std::uniform_real_distribution<double> distribution(0.0, 1.0);
-    std::vector<dense_bitset::iterator> pos(p);
-    rep (b, p)
-        pos[b] = is_boundarys[b].begin();
-    vid_t count = 0;
-    while (count < num_vertices) {
-        long long r = distribution(gen) * sum;
-        int k;
-        for (k = 0; k < p; k++) {
-            if (r < quota[k])
-                break;
-            r -= quota[k];
+    int nthreads = std::max(1, std::min(FLAGS_ne_threads, p - 1));
+    std::vector<expansion_t> expansions(nthreads);
+    seeds.build(adj, num_vertices, 2 * average_degree);
+    for (auto &x : expansions) {
+        x.assigned_edges = x.conflicts = 0;
+        x.current.resize(num_vertices);
+        x.has_edges.resize(num_vertices);
+        x.has_edges.clear();
+        x.min_heap.reserve(num_vertices);
+        x.gen.seed(gen());
+        x.seeds = seeds;
+    }
+    locks.resize(num_vertices);
+    locks.clear();
+
+    for (int first = 0; first < p - 1; first += nthreads) {
+        int n = std::min(nthreads, p - 1 - first);
+        rep (t, n)
+            std::cerr << first + t << ", ";
+#pragma omp parallel for num_threads(n) schedule(static, 1)
+        for (int t = 0; t < n; t++) {
+            expansion_t &x = expansions[t];
+            x.bucket = first + t;
+            while (occupied[x.bucket] < capacity) {
+                vid_t d, vid;
+                if (!x.min_heap.get_min(d, vid)) {
+                    if (!get_free_vertex(x, vid)) {
+                        DLOG(INFO) << "partition " << x.bucket
+                                   << " stop: no free vertices";
+                        break;
+                    }
+                } else
+                    x.min_heap.remove(vid);
+
+                occupy_vertex(x, vid);
+                if (x.edges.size() >= EXPANSION_BATCH)
+                    flush(x);
+            }
+            x.min_heap.clear();
+            flush(x);
         }
-        while (pos[k] != is_boundarys[k].end() && master[*pos[k]] != -1)
-            pos[k]++;
-        if (pos[k] != is_boundarys[k].end()) {
-            count++;
-            master[*pos[k]] = k;
-            writer.save_vertex(*pos[k], k);
-            count_master[k]++;
-            quota[k]--;
-            sum--;
+        rep (t, n) {
+            expansion_t &x = expansions[t];
+            compact_adjlists(x.dirty);
+            // boundaries that lost every edge to other threads are no replicas
+            for (vid_t v : x.current.vertices) {
+                if (!x.has_edges.get(v))
+                    x.current.is_boundary.clear_bit_unsync(v);
+                x.has_edges.clear_bit_unsync(v);
+            }
+            x.current.finish(members, first + t);
+            x.seeds.refresh();
         }
+        adj.trim();
+    }
+
+    size_t conflicts = 0;
+    for (auto &x : expansions) {
+        assigned_edges += x.assigned_edges;
+        conflicts += x.conflicts;
     }
-    int max_masters =
-        *std::max_element(count_master.begin(), count_master.end());
-    LOG(INFO) << "master balance: "
-              << (double)max_masters / ((double)num_vertices / p);
+    LOG(INFO) << "grew " << nthreads << " partitions at a time, "
+              << conflicts << " edges claimed by another partition first";
 }
 
-size_t NePartitioner::count_mirrors()
+/*
+ * Drops the assigned edges from the adjacency lists of the dirty vertices,
+ * the only lists that can hold one, so that the cost follows the edges
+ * assigned since the last call rather than the size of the graph
+ */
+template <typename vid_t, typename heap_t>
+void NePartitioner<vid_t, heap_t>::compact_adjlists(
+    std::vector<vid_t> &vertices)
 {
-    size_t result = 0;
-    rep (i, p)
-        result += is_boundarys[i].popcount();
-    return result;
+#pragma omp parallel for schedule(dynamic, 1024)
+    for (size_t j = 0; j < vertices.size(); j++) {
+        vid_t vid = vertices[j];
+        adj.touch(vid);
+        adjlist_t<vid_t> neighbors = adj[vid];
+        for (size_t i = 0; i < neighbors.size();) {
+            if (!removed_edges.get(neighbors[i].e)) {
+                i++;
+            } else {
+                std::swap(neighbors[i], neighbors.back());
+                neighbors.pop_back();
+            }
+        }
+        dirty.clear_bit(vid);
+    }
+    vertices.clear();
 }
 
-void NePartitioner::split()
+template <typename vid_t, typename heap_t>
+void NePartitioner<vid_t, heap_t>::assign_remaining()
+{
+    // an edge is left in the list of one end alone if the other end
+    // became a core while the partition was already full
+    repv (u, num_vertices) {
+        for (auto &i : adj[u])
+            if (!removed_edges.get(i.e)) {
+                removed_edges.set_bit_unsync(i.e);
+                assign_edge(p - 1, i.out ? u : i.v, i.out ? i.v : u);
+                current.set_boundary(u);
+                current.set_boundary(i.v);
+            }
+        adj.touch(u);
+    }
+
+    current.finish_last(members, p - 1);
+}
+
+template <typename vid_t, typename heap_t>
+size_t NePartitioner<vid_t, heap_t>::count_mirrors()
+{
+    return members.count(MEMBER_BOUNDARY);
+}
+
+template <typename vid_t, typename heap_t>
+void NePartitioner<vid_t, heap_t>::split()
 {
     LOG(INFO) << "partition `" << basefilename << "'";
     LOG(INFO) << "number of partitions: " << p;
 
     Timer compute_timer;
 
-    min_heap.reserve(num_vertices);
-
     LOG(INFO) << "partitioning...";
     compute_timer.start();
-    for (bucket = 0; bucket < p - 1; bucket++) {
-        std::cerr << bucket << ", ";
-        DLOG(INFO) << "sample size: " << adj_out.num_edges();
-        while (occupied[bucket] < capacity) {
-            vid_t d, vid;
-            if (!min_heap.get_min(d, vid)) {
-                if (!get_free_vertex(vid)) {
-                    DLOG(INFO) << "partition " << bucket
-                               << " stop: no free vertices";
-                    break;
-                }
-                d = adj_out[vid].size() + adj_in[vid].size();
-            } else {
-                min_heap.remove(vid);
-                /* CHECK_EQ(d, adj_out[vid].size() + adj_in[vid].size()); */
-            }
-
-            occupy_vertex(vid, d);
-        }
-        min_heap.clear();
-        rep (direction, 2)
-            repv (vid, num_vertices) {
-                adjlist_t &neighbors = direction ? adj_out[vid] : adj_in[vid];
-                for (size_t i = 0; i < neighbors.size();) {
-                    if (edges[neighbors[i].v].valid()) {
-                        i++;
-                    } else {
-                        std::swap(neighbors[i], neighbors.back());
-                        neighbors.pop_back();
-                    }
-                }
-            }
-    }
+    if (FLAGS_ne_threads > 1)
+        expand_parallel();
+    else
+        expand();
     bucket = p - 1;
     std::cerr << bucket << std::endl;
     assign_remaining();
-    assign_master();
+    std::vector<uint16_t> master;
+    assign_master(members, num_vertices, gen, *writer, master);
+    if (FLAGS_output_replicas)
+        save_replica_map<vid_t>(replicas_name(basefilename), members, master);
     compute_timer.stop();
+    writer->close();
     LOG(INFO) << "expected edges in each partition: " << num_edges / p;
     rep (i, p)
         DLOG(INFO) << "edges in partition " << i << ": " << occupied[i];
@@ -188,3 +270,8 @@ void NePartitioner::split()
     total_time.stop();
     LOG(INFO) << "total partition time: " << total_time.get_time();
 }
+
+template class NePartitioner<uint32_t>;
+template class NePartitioner<uint64_t>;
+template class NePartitioner<uint32_t, BucketQueue<uint32_t, uint32_t>>;
+template class NePartitioner<uint64_t, BucketQueue<uint64_t, uint64_t>>;
@@ -5,6 +5,9 @@
 #include <iostream>
 #include <fstream>
 #include <random>
+#include <memory>
+#include <mutex>
+#include <thread>
 #include <fcntl.h>
 #include <sys/stat.h>
 #include <sys/mman.h>
@@ -12,15 +15,23 @@
 
 #include "util.hpp"
 #include "min_heap.hpp"
+#include "bucket_queue.hpp"
 #include "dense_bitset.hpp"
 #include "edgepart.hpp"
 #include "partitioner.hpp"
 #include "graph.hpp"
+#include "seed_index.hpp"
+
+DECLARE_int32(ne_threads);
+DECLARE_string(ne_storage);
 
 /* Neighbor Expansion (NE) */
+template <typename vid_t, typename heap_t = MinHeap<vid_t, vid_t>>
 class NePartitioner : public Partitioner
 {
   private:
+    typedef basic_edge_t<vid_t> edge_t;
+
     const double BALANCE_RATIO = 1.00;
 
     std::string basefilename;
@@ -31,138 +42,254 @@ class NePartitioner : public Partitioner
     double average_degree;
     size_t capacity;
 
-    std::vector<edge_t> edges;
-    graph_t adj_out, adj_in;
-    MinHeap<vid_t, vid_t> min_heap;
+    graph_t<vid_t> adj;
+    dense_bitset removed_edges;
+    // vertices with an assigned edge left in their lists
+    dense_bitset dirty;
+    std::vector<vid_t> dirty_vertices;
+    heap_t min_heap;
     std::vector<size_t> occupied;
     std::vector<vid_t> degrees;
-    std::vector<int8_t> master;
-    std::vector<dense_bitset> is_cores, is_boundarys;
+    membership members;             // of the partitions grown so far
+    dense_partition<vid_t> current; // of the partition being grown
 
     std::random_device rd;
     std::mt19937 gen;
-    std::uniform_int_distribution<vid_t> dis;
+    seed_index<vid_t> seeds;
 
-    edgepart_writer<vid_t, uint16_t> writer;
+    std::unique_ptr<edgepart_writer<vid_t, uint16_t>> writer;
 
-    int check_edge(const edge_t *e)
-    {
-        rep (i, bucket) {
-            auto &is_boundary = is_boundarys[i];
-            if (is_boundary.get(e->first) && is_boundary.get(e->second) &&
-                occupied[i] < capacity) {
-                return i;
-            }
-        }
+    /*
+     * A partition grown by its own thread (-ne_threads). The partitions
+     * grown at once share the graph: a thread claims an edge by setting its
+     * bit in removed_edges, so that an edge reached by two partitions goes
+     * to the first one, and takes the lock of a vertex while it walks or
+     * shrinks the adjacency lists of the vertex. Only claimed edges are
+     * dropped from the lists, so an edge stays in sight of every thread
+     * until one of them takes it. Everything else, the heap and the core and
+     * boundary sets of the partition included, is private to the thread;
+     * the edges are handed to the writer in batches.
+     */
+    struct expansion_t {
+        int bucket;
+        size_t assigned_edges, conflicts;
+        dense_partition<vid_t> current;
+        dense_bitset has_edges; // of current, the rest lost every edge
+        heap_t min_heap;
+        std::mt19937 gen;
+        seed_index<vid_t> seeds;
+        std::vector<vid_t> frontier, dirty;
+        std::vector<edge_t> edges;
+        std::vector<uint16_t> procs;
+    };
 
-        rep (i, bucket) {
-            auto &is_core = is_cores[i], &is_boundary = is_boundarys[i];
-            if ((is_core.get(e->first) || is_core.get(e->second)) &&
-                occupied[i] < capacity) {
-                if (is_core.get(e->first) && degrees[e->second] > average_degree)
-                    continue;
-                if (is_core.get(e->second) && degrees[e->first] > average_degree)
-                    continue;
-                is_boundary.set_bit(e->first);
-                is_boundary.set_bit(e->second);
-                return i;
-            }
-        }
+    const size_t EXPANSION_BATCH = 64 * 1024;
+
+    dense_bitset locks;
+    std::mutex writer_mutex;
 
-        return p;
+    void lock_vertex(vid_t vid)
+    {
+        while (locks.set_bit(vid))
+            std::this_thread::yield();
     }
 
+    void unlock_vertex(vid_t vid) { locks.clear_bit(vid); }
+
     void assign_edge(int bucket, vid_t from, vid_t to)
     {
-        writer.save_edge(from, to, bucket);
+        writer->save_edge(from, to, bucket);
         assigned_edges++;
         occupied[bucket]++;
         degrees[from]--;
         degrees[to]--;
     }
 
+    /* Marks u, whose lists keep an edge assigned from the other end */
+    void mark_dirty(vid_t u)
+    {
+        if (!dirty.set_bit_unsync(u))
+            dirty_vertices.push_back(u);
+    }
+
     void add_boundary(vid_t vid)
     {
-        auto &is_core = is_cores[bucket], &is_boundary = is_boundarys[bucket];
+        auto &is_core = current.is_core, &is_boundary = current.is_boundary;
 
         if (is_boundary.get(vid))
             return;
-        is_boundary.set_bit_unsync(vid);
+        current.set_boundary(vid);
 
         if (!is_core.get(vid)) {
-            min_heap.insert(adj_out[vid].size() + adj_in[vid].size(), vid);
+            min_heap.insert(adj[vid].size(), vid);
         }
+        adj.touch(vid);
 
-        rep (direction, 2) {
-            adjlist_t &neighbors = direction ? adj_out[vid] : adj_in[vid];
-            for (size_t i = 0; i < neighbors.size();) {
-                if (edges[neighbors[i].v].valid()) {
-                    vid_t &u = direction ? edges[neighbors[i].v].second : edges[neighbors[i].v].first;
-                    if (is_core.get(u)) {
-                        assign_edge(bucket, direction ? vid : u,
-                                    direction ? u : vid);
-                        min_heap.decrease_key(vid);
-                        edges[neighbors[i].v].remove();
-                        std::swap(neighbors[i], neighbors.back());
-                        neighbors.pop_back();
-                    } else if (is_boundary.get(u) &&
-                               occupied[bucket] < capacity) {
-                        assign_edge(bucket, direction ? vid : u,
-                                    direction ? u : vid);
-                        min_heap.decrease_key(vid);
-                        min_heap.decrease_key(u);
-                        edges[neighbors[i].v].remove();
-                        std::swap(neighbors[i], neighbors.back());
-                        neighbors.pop_back();
-                    } else
-                        i++;
-                } else {
+        adjlist_t<vid_t> neighbors = adj[vid];
+        for (size_t i = 0; i < neighbors.size();) {
+            if (!removed_edges.get(neighbors[i].e)) {
+                vid_t u = neighbors[i].v;
+                bool out = neighbors[i].out;
+                if (is_core.get(u)) {
+                    assign_edge(bucket, out ? vid : u, out ? u : vid);
+                    min_heap.decrease_key(vid);
+                    removed_edges.set_bit_unsync(neighbors[i].e);
+                    mark_dirty(u);
                     std::swap(neighbors[i], neighbors.back());
                     neighbors.pop_back();
-                }
+                } else if (is_boundary.get(u) &&
+                           occupied[bucket] < capacity) {
+                    assign_edge(bucket, out ? vid : u, out ? u : vid);
+                    min_heap.decrease_key(vid);
+                    min_heap.decrease_key(u);
+                    removed_edges.set_bit_unsync(neighbors[i].e);
+                    mark_dirty(u);
+                    std::swap(neighbors[i], neighbors.back());
+                    neighbors.pop_back();
+                } else
+                    i++;
+            } else {
+                std::swap(neighbors[i], neighbors.back());
+                neighbors.pop_back();
             }
         }
     }
 
     void occupy_vertex(vid_t vid, vid_t d)
     {
-        CHECK(!is_cores[bucket].get(vid)) << "add " << vid << " to core again";
-        is_cores[bucket].set_bit_unsync(vid);
+        CHECK(!current.is_core.get(vid)) << "add " << vid << " to core again";
+        current.set_core(vid);
 
         if (d == 0)
             return;
 
         add_boundary(vid);
 
-        for (auto &i : adj_out[vid])
-            if (edges[i.v].valid())
-                add_boundary(edges[i.v].second);
-        adj_out[vid].clear();
-
-        for (auto &i : adj_in[vid])
-            if (edges[i.v].valid())
-                add_boundary(edges[i.v].first);
-        adj_in[vid].clear();
+        for (auto &i : adj[vid])
+            if (!removed_edges.get(i.e))
+                add_boundary(i.v);
+        adj[vid].clear();
     }
 
     bool get_free_vertex(vid_t &vid)
     {
-        vid = dis(gen);
-        vid_t count = 0;
-        while (count < num_vertices &&
-               (adj_out[vid].size() + adj_in[vid].size() == 0 ||
-                adj_out[vid].size() + adj_in[vid].size() >
-                    2 * average_degree ||
-                is_cores[bucket].get(vid))) {
-            vid = (vid + ++count) % num_vertices;
+        return seeds.pick(gen, current.is_core, vid);
+    }
+
+    void assign_edge(expansion_t &x, vid_t from, vid_t to)
+    {
+        x.edges.push_back(edge_t(from, to));
+        x.procs.push_back(x.bucket);
+        x.has_edges.set_bit_unsync(from);
+        x.has_edges.set_bit_unsync(to);
+        x.assigned_edges++;
+        occupied[x.bucket]++;
+        __sync_fetch_and_sub(&degrees[from], 1);
+        __sync_fetch_and_sub(&degrees[to], 1);
+    }
+
+    void flush(expansion_t &x)
+    {
+        if (x.edges.empty())
+            return;
+        std::lock_guard<std::mutex> lock(writer_mutex);
+        // one by one, so that the async writer queues them for its thread;
+        // save_edges would wait for it to catch up and write them here
+        for (size_t i = 0; i < x.edges.size(); i++)
+            writer->save_edge(x.edges[i].first, x.edges[i].second,
+                              x.procs[i]);
+        x.edges.clear();
+        x.procs.clear();
+    }
+
+    void add_boundary(expansion_t &x, vid_t vid)
+    {
+        auto &is_core = x.current.is_core,
+             &is_boundary = x.current.is_boundary;
+
+        if (is_boundary.get(vid))
+            return;
+        x.current.set_boundary(vid);
+
+        lock_vertex(vid);
+        if (!is_core.get(vid)) {
+            x.min_heap.insert(adj[vid].size(), vid);
+        }
+        adj.touch(vid);
+
+        adjlist_t<vid_t> neighbors = adj[vid];
+        for (size_t i = 0; i < neighbors.size();) {
+            if (!removed_edges.get(neighbors[i].e)) {
+                vid_t u = neighbors[i].v;
+                bool out = neighbors[i].out, core = is_core.get(u);
+                if (!core &&
+                    !(is_boundary.get(u) && occupied[x.bucket] < capacity)) {
+                    i++;
+                    continue;
+                }
+                if (!removed_edges.set_bit(neighbors[i].e)) {
+                    assign_edge(x, out ? vid : u, out ? u : vid);
+                    x.min_heap.decrease_key(vid);
+                    if (!core)
+                        x.min_heap.decrease_key(u);
+                    if (!dirty.set_bit(u))
+                        x.dirty.push_back(u);
+                } else
+                    x.conflicts++;
+            }
+            std::swap(neighbors[i], neighbors.back());
+            neighbors.pop_back();
         }
-        if (count == num_vertices)
-            return false;
-        return true;
+        unlock_vertex(vid);
+    }
+
+    void occupy_vertex(expansion_t &x, vid_t vid)
+    {
+        CHECK(!x.current.is_core.get(vid))
+            << "add " << vid << " to core again";
+        x.current.set_core(vid);
+
+        lock_vertex(vid);
+        bool isolated = adj[vid].size() == 0;
+        unlock_vertex(vid);
+        if (isolated)
+            return;
+
+        add_boundary(x, vid);
+
+        // collect the neighbors first: a thread holds one lock at a time
+        x.frontier.clear();
+        lock_vertex(vid);
+        adjlist_t<vid_t> neighbors = adj[vid];
+        for (size_t i = 0; i < neighbors.size();) {
+            if (!removed_edges.get(neighbors[i].e)) {
+                x.frontier.push_back(neighbors[i].v);
+                i++;
+            } else {
+                std::swap(neighbors[i], neighbors.back());
+                neighbors.pop_back();
+            }
+        }
+        unlock_vertex(vid);
+        for (vid_t u : x.frontier)
+            add_boundary(x, u);
+    }
+
+    bool get_free_vertex(expansion_t &x, vid_t &vid)
+    {
+        // other threads shrink the lists under their locks
+        return x.seeds.pick(x.gen, x.current.is_core, vid, [this](vid_t v) {
+            lock_vertex(v);
+            size_t d = adj[v].size();
+            unlock_vertex(v);
+            return d;
+        });
     }
 
+    void expand();
+    void expand_parallel();
+    void compact_adjlists(std::vector<vid_t> &vertices);
     void assign_remaining();
-    void assign_master();
     size_t count_mirrors();
 
   public:
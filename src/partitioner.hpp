@@ -1,6 +1,13 @@
 #pragma once
 
+#include <vector>
+#include <random>
+
 #include "util.hpp"
+#include "dense_bitset.hpp"
+#include "membership.hpp"
+#include "edgepart.hpp"
+#include "replica_map.hpp"
 
 class Partitioner
 {
@@ -10,3 +17,104 @@ class Partitioner
   public:
     virtual void split() = 0;
 };
+
+/* Sets bit v of a bitset shared by threads, skipping the atomic if set */
+inline void mark_mirror(dense_bitset &is_mirror, size_t v)
+{
+    if (!is_mirror.get(v))
+        is_mirror.set_bit(v);
+}
+
+/*
+ * Picks the master of every vertex among the partitions holding one of its
+ * replicas, at random with the partitions weighted by how many masters they
+ * still lack from num_vertices, and saves it to the writer and to master.
+ * mirrors[k] ranges over the replicas of partition k in increasing order.
+ */
+template <typename vid_t, typename proc_t, typename iterator_t>
+void pick_masters(std::vector<std::pair<iterator_t, iterator_t>> &mirrors,
+                  vid_t num_vertices, std::mt19937 &gen,
+                  edgepart_writer<vid_t, proc_t> &writer,
+                  std::vector<proc_t> &master)
+{
+    int p = mirrors.size();
+    dense_bitset has_master(num_vertices);
+    master.resize(num_vertices);
+    std::vector<vid_t> count_master(p, 0);
+    std::vector<long long> quota(p, num_vertices);
+    long long sum = (long long)p * num_vertices;
+    std::uniform_real_distribution<double> distribution(0.0, 1.0);
+    vid_t count = 0;
+    while (count < num_vertices) {
+        long long r = distribution(gen) * sum;
+        int k;
+        for (k = 0; k < p; k++) {
+            if (r < quota[k])
+                break;
+            r -= quota[k];
+        }
+        iterator_t &pos = mirrors[k].first, &end = mirrors[k].second;
+        while (pos != end && has_master.get(*pos))
+            pos++;
+        if (pos != end) {
+            count++;
+            has_master.set_bit_unsync(*pos);
+            writer.save_vertex(*pos, k);
+            master[*pos] = k;
+            count_master[k]++;
+            quota[k]--;
+            sum--;
+        }
+    }
+    vid_t max_masters =
+        *std::max_element(count_master.begin(), count_master.end());
+    LOG(INFO) << "master balance: "
+              << (double)max_masters / ((double)num_vertices / p);
+}
+
+/* Picks the masters from the replicas of every partition (is_mirrors) */
+template <typename vid_t, typename proc_t>
+void assign_master(const std::vector<dense_bitset> &is_mirrors,
+                   vid_t num_vertices, std::mt19937 &gen,
+                   edgepart_writer<vid_t, proc_t> &writer,
+                   std::vector<proc_t> &master)
+{
+    std::vector<std::pair<dense_bitset::iterator, dense_bitset::iterator>>
+        mirrors;
+    for (auto &is_mirror : is_mirrors)
+        mirrors.emplace_back(is_mirror.begin(), is_mirror.end());
+    pick_masters(mirrors, num_vertices, gen, writer, master);
+}
+
+/* Picks the masters from the boundary entries of the membership */
+template <typename vid_t, typename proc_t>
+void assign_master(const membership &members, vid_t num_vertices,
+                   std::mt19937 &gen, edgepart_writer<vid_t, proc_t> &writer,
+                   std::vector<proc_t> &master)
+{
+    // the replicas of every partition in increasing order of id
+    int p = members.num_partitions();
+    std::vector<size_t> offsets(p + 1, 0);
+    repv (v, num_vertices) {
+        const uint16_t *a = members.entries(v);
+        rep (i, members.size(v))
+            if (a[i] & MEMBER_BOUNDARY)
+                offsets[(a[i] & MEMBER_PARTITION) + 1]++;
+    }
+    rep (k, p)
+        offsets[k + 1] += offsets[k];
+    std::vector<vid_t> vertices(offsets[p]);
+    std::vector<size_t> pos(offsets.begin(), offsets.end() - 1);
+    repv (v, num_vertices) {
+        const uint16_t *a = members.entries(v);
+        rep (i, members.size(v))
+            if (a[i] & MEMBER_BOUNDARY)
+                vertices[pos[a[i] & MEMBER_PARTITION]++] = v;
+    }
+
+    std::vector<std::pair<const vid_t *, const vid_t *>> mirrors;
+    rep (k, p)
+        mirrors.emplace_back(vertices.data() + offsets[k],
+                             vertices.data() + offsets[k + 1]);
+    pick_masters(mirrors, num_vertices, gen, writer, master);
+}
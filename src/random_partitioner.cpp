@@ -5,38 +5,24 @@
 #include "random_partitioner.hpp"
 #include "conversions.hpp"
 
-RandomPartitioner::RandomPartitioner(std::string basefilename)
+template <typename vid_t>
+RandomPartitioner<vid_t>::RandomPartitioner(std::string basefilename)
+    : basefilename(basefilename), rd(), gen(rd()),
+      writer(new_edgepart_writer<vid_t, uint16_t>(basefilename, FLAGS_p))
 {
     Timer convert_timer;
     convert_timer.start();
-    convert(basefilename, new Converter(basefilename));
+    convert(basefilename, new Converter<vid_t>(basefilename));
     convert_timer.stop();
     LOG(INFO) << "convert time: " << convert_timer.get_time();
 
     total_time.start();
     LOG(INFO) << "initializing partitioner";
 
-    fin = open(binedgelist_name(basefilename).c_str(), O_RDONLY, (mode_t)0600);
-    PCHECK(fin != -1) << "Error opening file for read";
-    struct stat fileInfo = {0};
-    PCHECK(fstat(fin, &fileInfo) != -1) << "Error getting the file size";
-    PCHECK(fileInfo.st_size != 0) << "Error: file is empty";
-    LOG(INFO) << "file size: " << fileInfo.st_size;
-
-    fin_map = (char *)mmap(0, fileInfo.st_size, PROT_READ, MAP_SHARED, fin, 0);
-    if (fin_map == MAP_FAILED) {
-        close(fin);
-        PLOG(FATAL) << "error mapping the file";
-    }
-
-    filesize = fileInfo.st_size;
-    fin_ptr = fin_map;
-    fin_end = fin_map + filesize;
-
-    num_vertices = *(vid_t *)fin_ptr;
-    fin_ptr += sizeof(vid_t);
-    num_edges = *(size_t *)fin_ptr;
-    fin_ptr += sizeof(size_t);
+    stream.open(FLAGS_compress ? cbinedgelist_name(basefilename)
+                               : binedgelist_name(basefilename));
+    num_vertices = stream.num_vertices();
+    num_edges = stream.num_edges();
 
     LOG(INFO) << "num_vertices: " << num_vertices
               << ", num_edges: " << num_edges;
@@ -44,28 +30,42 @@ RandomPartitioner::RandomPartitioner(std::string basefilename)
     p = FLAGS_p;
 }
 
-void RandomPartitioner::split()
+template <typename vid_t>
+void RandomPartitioner<vid_t>::split()
 {
     std::vector<dense_bitset> is_mirrors(p, dense_bitset(num_vertices));
     std::vector<size_t> counter(p, 0);
+    std::vector<uint16_t> buckets;
     auto hash = std::hash<vid_t>();
-    while (fin_ptr < fin_end) {
-        edge_t *e = (edge_t *)fin_ptr;
-        fin_ptr += sizeof(edge_t);
-        vid_t u = e->first, v = e->second;
-        if (u > v) std::swap(u, v);
-        int bucket = (hash(u) ^ (hash(v) << 1)) % p;
-        counter[bucket]++;
-        is_mirrors[bucket].set_bit_unsync(u);
-        is_mirrors[bucket].set_bit_unsync(v);
+    const edge_t *edges;
+    while (size_t n = stream.next(edges)) {
+        buckets.resize(n);
+#pragma omp parallel
+        {
+            std::vector<size_t> local_counter(p, 0);
+#pragma omp for
+            for (size_t i = 0; i < n; i++) {
+                vid_t u = edges[i].first, v = edges[i].second;
+                if (u > v) std::swap(u, v);
+                int bucket = (hash(u) ^ (hash(v) << 1)) % p;
+                buckets[i] = bucket;
+                local_counter[bucket]++;
+                mark_mirror(is_mirrors[bucket], u);
+                mark_mirror(is_mirrors[bucket], v);
+            }
+#pragma omp critical
+            rep (b, p)
+                counter[b] += local_counter[b];
+        }
+        writer->save_edges(edges, &buckets[0], n);
     }
-
-    if (munmap(fin_map, filesize) == -1) {
-        close(fin);
-        PLOG(FATAL) << "Error un-mmapping the file";
-    }
-    close(fin);
-
+    stream.close();
+    std::vector<uint16_t> master;
+    assign_master(is_mirrors, num_vertices, gen, *writer, master);
+    if (FLAGS_output_replicas)
+        save_replica_map<vid_t>(replicas_name(basefilename), is_mirrors,
+                                    master);
+    writer->close();
 
     size_t max_occupied = *std::max_element(counter.begin(), counter.end());
     LOG(INFO) << "balance: " << (double)max_occupied / ((double)num_edges / p);
@@ -78,3 +78,6 @@ void RandomPartitioner::split()
     total_time.stop();
     LOG(INFO) << "total partition time: " << total_time.get_time();
 }
+
+template class RandomPartitioner<uint32_t>;
+template class RandomPartitioner<uint64_t>;
@@ -5,20 +5,21 @@
 #include <iostream>
 #include <fstream>
 #include <random>
-#include <fcntl.h>
-#include <sys/stat.h>
-#include <sys/mman.h>
-#include <unistd.h>
+#include <memory>
 #include <parallel/algorithm>
 
 #include "util.hpp"
 #include "dense_bitset.hpp"
 #include "edgepart.hpp"
 #include "partitioner.hpp"
+#include "edge_stream.hpp"
 
+template <typename vid_t>
 class RandomPartitioner : public Partitioner
 {
   private:
+    typedef basic_edge_t<vid_t> edge_t;
+
     const size_t BUFFER_SIZE = 64 * 1024 / sizeof(edge_t);
     std::string basefilename;
 
@@ -26,10 +27,11 @@ class RandomPartitioner : public Partitioner
     size_t num_edges;
     int p;
 
-    // use mmap for file input
-    int fin;
-    off_t filesize;
-    char *fin_map, *fin_ptr, *fin_end;
+    edge_stream<vid_t> stream;
+
+    std::random_device rd;
+    std::mt19937 gen;
+    std::unique_ptr<edgepart_writer<vid_t, uint16_t>> writer;
 
   public:
     RandomPartitioner(std::string basefilename);
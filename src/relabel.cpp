@@ -0,0 +1,184 @@
+#include <algorithm>
+#include <parallel/algorithm>
+#include <omp.h>
+
+#include "relabel.hpp"
+#include "dense_bitset.hpp"
+
+namespace
+{
+
+template <typename vid_t>
+inline vid_t endpoint(const basic_edge_t<vid_t> *edges, size_t pos)
+{
+    return pos & 1 ? edges[pos >> 1].second : edges[pos >> 1].first;
+}
+
+// Maps the position of an endpoint to the number of first appearances
+// before it, i.e., the new id of the vertex first seen at that position
+class rank_t
+{
+  private:
+    dense_bitset &firsts;
+    std::vector<size_t> prefix;
+
+  public:
+    rank_t(dense_bitset &firsts) : firsts(firsts)
+    {
+        size_t nwords = (firsts.size() + 63) / 64;
+        prefix.resize(nwords + 1);
+        prefix[0] = 0;
+#pragma omp parallel for
+        for (size_t i = 0; i < nwords; i++)
+            prefix[i + 1] = __builtin_popcountl(firsts.containing_word(i * 64));
+        for (size_t i = 0; i < nwords; i++)
+            prefix[i + 1] += prefix[i];
+    }
+
+    size_t num_ones() const { return prefix.back(); }
+
+    size_t operator()(size_t pos) const
+    {
+        size_t below = (size_t(1) << (pos & 63)) - 1;
+        return prefix[pos / 64] +
+               __builtin_popcountl(firsts.containing_word(pos) & below);
+    }
+};
+
+template <typename vid_t>
+struct first_t {
+    vid_t raw;
+    size_t pos;
+    bool operator<(const first_t &o) const
+    {
+        return raw < o.raw || (raw == o.raw && pos < o.pos);
+    }
+    bool operator==(const first_t &o) const { return raw == o.raw; }
+};
+
+template <typename T>
+void sort_unique(std::vector<T> &v)
+{
+    std::sort(v.begin(), v.end());
+    v.erase(std::unique(v.begin(), v.end()), v.end());
+}
+
+} // namespace
+
+template <typename vid_t>
+vid_t relabel_edges(basic_edge_t<vid_t> *edges, size_t num_edges,
+                    std::vector<vid_t> &degrees, size_t memsize)
+{
+    typedef basic_edge_t<vid_t> edge_t;
+
+    size_t npos = num_edges * 2;
+    vid_t max_raw = 0;
+#pragma omp parallel for reduction(max : max_raw)
+    for (size_t i = 0; i < num_edges; i++)
+        max_raw = std::max(max_raw, std::max(edges[i].first, edges[i].second));
+
+    dense_bitset firsts(npos);
+    if (num_edges > 0 && max_raw < memsize / sizeof(size_t)) {
+        size_t table_size = (size_t)max_raw + 1;
+        // flat path: index a table by the raw id directly, which covers ids
+        // that already form a dense range
+        LOG(INFO) << "relabel: flat table of " << table_size << " ids";
+        std::vector<size_t> table(table_size);
+#pragma omp parallel for
+        for (size_t r = 0; r < table_size; r++)
+            table[r] = (size_t)-1;
+#pragma omp parallel for
+        for (size_t pos = 0; pos < npos; pos++) {
+            size_t *first = &table[endpoint(edges, pos)];
+            size_t cur = *first;
+            while (pos < cur && !__sync_bool_compare_and_swap(first, cur, pos))
+                cur = *first;
+        }
+#pragma omp parallel for
+        for (size_t r = 0; r < table_size; r++)
+            if (table[r] != (size_t)-1)
+                firsts.set_bit(table[r]);
+
+        rank_t rank(firsts);
+        CHECK_LE(rank.num_ones(), (size_t)edge_t::INVALID_VID) << "too many vertices";
+        degrees.assign(rank.num_ones(), 0);
+#pragma omp parallel for
+        for (size_t r = 0; r < table_size; r++)
+            if (table[r] != (size_t)-1)
+                table[r] = rank(table[r]);
+#pragma omp parallel for
+        for (size_t i = 0; i < num_edges; i++) {
+            edges[i].first = table[edges[i].first];
+            edges[i].second = table[edges[i].second];
+            __sync_fetch_and_add(&degrees[edges[i].first], 1);
+            __sync_fetch_and_add(&degrees[edges[i].second], 1);
+        }
+        return rank.num_ones();
+    }
+
+    // sparse path: every thread collects the distinct ids of its range
+    // together with their first positions, then the lists are merged
+    LOG(INFO) << "relabel: sorting distinct ids (max id " << max_raw << ")";
+    const size_t block = 1 << 20;
+    int nthreads = omp_get_max_threads();
+    std::vector<std::vector<first_t<vid_t>>> local(nthreads);
+#pragma omp parallel num_threads(nthreads)
+    {
+        std::vector<first_t<vid_t>> &ids = local[omp_get_thread_num()], buf;
+        size_t compacted = 0;
+#pragma omp for schedule(static)
+        for (size_t b = 0; b < npos; b += block) {
+            buf.clear();
+            for (size_t pos = b; pos < std::min(npos, b + block); pos++)
+                buf.push_back(first_t<vid_t>{endpoint(edges, pos), pos});
+            sort_unique(buf);
+            ids.insert(ids.end(), buf.begin(), buf.end());
+            if (ids.size() > 2 * compacted + block) {
+                sort_unique(ids);
+                compacted = ids.size();
+            }
+        }
+        sort_unique(ids);
+    }
+    std::vector<first_t<vid_t>> ids;
+    for (auto &l : local) {
+        ids.insert(ids.end(), l.begin(), l.end());
+        std::vector<first_t<vid_t>>().swap(l);
+    }
+    __gnu_parallel::sort(ids.begin(), ids.end());
+    ids.erase(std::unique(ids.begin(), ids.end()), ids.end());
+    CHECK_LE(ids.size(), (size_t)edge_t::INVALID_VID) << "too many vertices";
+
+#pragma omp parallel for
+    for (size_t i = 0; i < ids.size(); i++)
+        firsts.set_bit(ids[i].pos);
+    rank_t rank(firsts);
+
+    // lookup table sorted by raw id
+    std::vector<vid_t> raws(ids.size()), labels(ids.size());
+#pragma omp parallel for
+    for (size_t i = 0; i < ids.size(); i++) {
+        raws[i] = ids[i].raw;
+        labels[i] = rank(ids[i].pos);
+    }
+    std::vector<first_t<vid_t>>().swap(ids);
+
+    degrees.assign(raws.size(), 0);
+#pragma omp parallel for
+    for (size_t i = 0; i < num_edges; i++) {
+        edges[i].first = labels[std::lower_bound(raws.begin(), raws.end(),
+                                                 edges[i].first) -
+                                raws.begin()];
+        edges[i].second = labels[std::lower_bound(raws.begin(), raws.end(),
+                                                  edges[i].second) -
+                                 raws.begin()];
+        __sync_fetch_and_add(&degrees[edges[i].first], 1);
+        __sync_fetch_and_add(&degrees[edges[i].second], 1);
+    }
+    return raws.size();
+}
+
+template uint32_t relabel_edges(basic_edge_t<uint32_t> *, size_t,
+                                std::vector<uint32_t> &, size_t);
+template uint64_t relabel_edges(basic_edge_t<uint64_t> *, size_t,
+                                std::vector<uint64_t> &, size_t);
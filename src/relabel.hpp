@@ -0,0 +1,16 @@
+#pragma once
+
+#include <vector>
+
+#include "util.hpp"
+
+/*
+ * Renumbers the raw vertex ids of edges[0..num_edges) in place to
+ * 0..num_vertices-1 in order of first appearance (the numbering
+ * Converter::get_vid produces) and fills in the degrees. Returns the number
+ * of vertices. memsize bounds the flat raw-id lookup table; larger id ranges
+ * are handled by sorting the distinct ids.
+ */
+template <typename vid_t>
+vid_t relabel_edges(basic_edge_t<vid_t> *edges, size_t num_edges,
+                    std::vector<vid_t> &degrees, size_t memsize);
@@ -0,0 +1,124 @@
+#include <omp.h>
+
+#include "replica_map.hpp"
+#include "block_writer.hpp"
+
+namespace
+{
+
+template <typename vid_t>
+void write_replica_map(const std::string &filename, int p,
+                       const std::vector<uint64_t> &offsets,
+                       const std::vector<uint16_t> &replicas, Timer &timer)
+{
+    replica_map_header header;
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, REPLICA_MAP_MAGIC, sizeof(header.magic));
+    header.version = REPLICA_MAP_VERSION;
+    header.vid_size = sizeof(vid_t);
+    header.num_partitions = p;
+    header.num_vertices = offsets.size() - 1;
+    header.num_replicas = replicas.size();
+    block_writer fout(filename);
+    fout.write((const char *)&header, sizeof(header));
+    fout.write((const char *)&offsets[0], offsets.size() * sizeof(uint64_t));
+    if (!replicas.empty())
+        fout.write((const char *)&replicas[0],
+                   replicas.size() * sizeof(uint16_t));
+    fout.close();
+    timer.stop();
+    LOG(INFO) << "saved " << replicas.size() << " replicas to `" << filename
+              << "' in " << timer.get_time() << "s";
+}
+
+} // namespace
+
+template <typename vid_t>
+void save_replica_map(const std::string &filename,
+                      const std::vector<dense_bitset> &is_mirrors,
+                      const std::vector<uint16_t> &master)
+{
+    Timer timer;
+    timer.start();
+    int p = is_mirrors.size();
+    CHECK_LT(p, REPLICA_MASTER) << "too many partitions for the replica map";
+    size_t num_vertices = master.size();
+    const size_t WORD = 8 * sizeof(size_t);
+    size_t num_words = (num_vertices + WORD - 1) / WORD;
+
+    // count the replicas of every vertex a bitset word at a time, so that
+    // threads never share a counter
+    std::vector<uint64_t> offsets(num_vertices + 1, 0);
+#pragma omp parallel for schedule(dynamic, 1024)
+    for (size_t w = 0; w < num_words; w++)
+        rep (b, p)
+            for (size_t word = is_mirrors[b].containing_word(w * WORD); word;
+                 word &= word - 1)
+                offsets[w * WORD + __builtin_ctzl(word) + 1]++;
+    prefix_sum(offsets);
+
+    std::vector<uint16_t> replicas(offsets[num_vertices]);
+#pragma omp parallel for schedule(dynamic, 1024)
+    for (size_t w = 0; w < num_words; w++) {
+        uint64_t pos[WORD];
+        size_t first = w * WORD, n = std::min(WORD, num_vertices - first);
+        std::copy(&offsets[first], &offsets[first] + n, pos);
+        rep (b, p)
+            for (size_t word = is_mirrors[b].containing_word(first); word;
+                 word &= word - 1) {
+                size_t i = __builtin_ctzl(word);
+                replicas[pos[i]++] =
+                    b | (master[first + i] == b ? REPLICA_MASTER : 0);
+            }
+    }
+
+    write_replica_map<vid_t>(filename, p, offsets, replicas, timer);
+}
+
+template <typename vid_t>
+void save_replica_map(const std::string &filename, const membership &members,
+                      const std::vector<uint16_t> &master)
+{
+    Timer timer;
+    timer.start();
+    int p = members.num_partitions();
+    CHECK_LT(p, REPLICA_MASTER) << "too many partitions for the replica map";
+    size_t num_vertices = master.size();
+
+    std::vector<uint64_t> offsets(num_vertices + 1, 0);
+#pragma omp parallel for schedule(dynamic, 4096)
+    for (size_t v = 0; v < num_vertices; v++) {
+        const uint16_t *a = members.entries(v);
+        rep (i, members.size(v))
+            offsets[v + 1] += (a[i] & MEMBER_BOUNDARY) != 0;
+    }
+    prefix_sum(offsets);
+
+    // the entries are sorted by partition already
+    std::vector<uint16_t> replicas(offsets[num_vertices]);
+#pragma omp parallel for schedule(dynamic, 4096)
+    for (size_t v = 0; v < num_vertices; v++) {
+        const uint16_t *a = members.entries(v);
+        uint64_t pos = offsets[v];
+        rep (i, members.size(v))
+            if (a[i] & MEMBER_BOUNDARY) {
+                uint16_t b = a[i] & MEMBER_PARTITION;
+                replicas[pos++] = b | (master[v] == b ? REPLICA_MASTER : 0);
+            }
+    }
+
+    write_replica_map<vid_t>(filename, p, offsets, replicas, timer);
+}
+
+template void save_replica_map<uint32_t>(const std::string &,
+                                         const std::vector<dense_bitset> &,
+                                         const std::vector<uint16_t> &);
+template void save_replica_map<uint64_t>(const std::string &,
+                                         const std::vector<dense_bitset> &,
+                                         const std::vector<uint16_t> &);
+template void save_replica_map<uint32_t>(const std::string &,
+                                         const membership &,
+                                         const std::vector<uint16_t> &);
+template void save_replica_map<uint64_t>(const std::string &,
+                                         const membership &,
+                                         const std::vector<uint16_t> &);
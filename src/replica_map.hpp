@@ -0,0 +1,45 @@
+#pragma once
+
+#include <string>
+#include <vector>
+
+#include "util.hpp"
+#include "dense_bitset.hpp"
+#include "membership.hpp"
+
+DECLARE_bool(output_replicas);
+
+/*
+ * Replica map (.replicas.<p>): for every vertex, the partitions holding a
+ * replica of it in CSR form, meant to be mapped by the loaders:
+ *
+ *   header   replica_map_header
+ *   offsets  uint64_t[num_vertices + 1], into the replica list
+ *   replicas uint16_t[num_replicas]
+ *
+ * The replicas of vertex v are replicas[offsets[v]] .. replicas[offsets[v +
+ * 1] - 1], in increasing order of partition; the one of the master
+ * partition has REPLICA_MASTER set.
+ */
+const char REPLICA_MAP_MAGIC[8] = {'R', 'E', 'P', 'L', 'I', 'C', 'A', 'S'};
+const uint32_t REPLICA_MAP_VERSION = 1;
+const uint16_t REPLICA_MASTER = 0x8000;
+
+struct replica_map_header {
+    char magic[8];
+    uint32_t version, vid_size;
+    uint32_t num_partitions, reserved;
+    uint64_t num_vertices, num_replicas;
+};
+
+/* Builds the replica map from the replicas (is_mirrors) and masters of the
+ * vertices in parallel and writes it to filename */
+template <typename vid_t>
+void save_replica_map(const std::string &filename,
+                      const std::vector<dense_bitset> &is_mirrors,
+                      const std::vector<uint16_t> &master);
+
+/* The same from the boundary entries of the membership */
+template <typename vid_t>
+void save_replica_map(const std::string &filename, const membership &members,
+                      const std::vector<uint16_t> &master);
@@ -0,0 +1,105 @@
+#pragma once
+
+#include <vector>
+#include <random>
+
+#include "util.hpp"
+#include "dense_bitset.hpp"
+#include "graph.hpp"
+
+/*
+ * Candidate seeds of the expansion: the vertices with some edges left but
+ * no more than max_degree, drawn uniformly at random. A drawn vertex that
+ * turns out to be exhausted is swap-removed for good; one that is a core of
+ * the partition or too large is parked and looked at again by refresh(),
+ * once the partition is done, so a search never sees it twice.
+ */
+template <typename vid_t>
+class seed_index
+{
+  private:
+    graph_t<vid_t> *adj;
+    std::vector<vid_t> candidates, parked;
+    double max_degree;
+
+    size_t degree(vid_t v)
+    {
+        return (*adj)[v].size();
+    }
+
+    static void swap_remove(std::vector<vid_t> &a, size_t i)
+    {
+        a[i] = a.back();
+        a.pop_back();
+    }
+
+  public:
+    /* Indexes the vertices with edges left in the graph */
+    void build(graph_t<vid_t> &adj, vid_t num_vertices, double max_degree)
+    {
+        this->adj = &adj;
+        this->max_degree = max_degree;
+        candidates.clear();
+        parked.clear();
+        repv (v, num_vertices) {
+            size_t d = degree(v);
+            if (d > max_degree)
+                parked.push_back(v);
+            else if (d > 0)
+                candidates.push_back(v);
+        }
+    }
+
+    /* Brings back the parked vertices that are candidates again */
+    void refresh()
+    {
+        refresh([this](vid_t v) { return degree(v); });
+    }
+
+    /* As refresh, with the degrees read through degree_fn */
+    template <typename degree_t>
+    void refresh(degree_t degree_fn)
+    {
+        for (size_t i = 0; i < parked.size();) {
+            size_t d = degree_fn(parked[i]);
+            if (d > max_degree) {
+                i++;
+                continue;
+            }
+            if (d > 0)
+                candidates.push_back(parked[i]);
+            swap_remove(parked, i);
+        }
+    }
+
+    bool pick(std::mt19937 &gen, const dense_bitset &is_core, vid_t &vid)
+    {
+        return pick(gen, is_core, vid,
+                    [this](vid_t v) { return degree(v); });
+    }
+
+    /* As pick, with the degrees read through degree_fn */
+    template <typename degree_t>
+    bool pick(std::mt19937 &gen, const dense_bitset &is_core, vid_t &vid,
+              degree_t degree_fn)
+    {
+        // parked vertices may have dropped below max_degree since the last
+        // refresh, so look at them once more before giving up
+        for (int round = 0; round < 2; round++) {
+            while (!candidates.empty()) {
+                size_t i = std::uniform_int_distribution<size_t>(
+                    0, candidates.size() - 1)(gen);
+                vid = candidates[i];
+                size_t d = degree_fn(vid);
+                if (d > 0 && d <= max_degree && !is_core.get(vid))
+                    return true;
+                if (d > 0)
+                    parked.push_back(vid);
+                swap_remove(candidates, i);
+            }
+            if (round == 0 && !parked.empty())
+                refresh(degree_fn);
+        }
+        return false;
+    }
+};
@@ -3,74 +3,191 @@
 #include <iostream>
 #include <fstream>
 
+#include <random>
 #include <stdlib.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <omp.h>
 
 #include "util.hpp"
 #include "shuffler.hpp"
 
-void Shuffler::init()
+namespace
 {
+
+/*
+ * Shuffles in[0..n) into out with all threads: every edge draws a random
+ * bucket, the edges are scattered to their buckets and every bucket is
+ * shuffled on its own, which gives a uniform permutation. The labels are
+ * drawn again from the same seeds in the scatter pass instead of being
+ * stored.
+ */
+template <typename edge_t>
+void parallel_shuffle(const edge_t *in, size_t n, edge_t *out, uint32_t seed)
+{
+    int nthreads = omp_get_max_threads();
+    size_t nbuckets = 1;
+    while (nbuckets < 4 * (size_t)nthreads ||
+           (nbuckets < (1 << 16) && nbuckets < (n >> 20)))
+        nbuckets <<= 1;
+    const size_t mask = nbuckets - 1;
+    std::vector<size_t> count(nthreads * nbuckets, 0);
+
+    // nthreads slices whatever the team size, so the result only depends
+    // on the seed and omp_get_max_threads()
+#pragma omp parallel num_threads(nthreads)
+    {
+#pragma omp for schedule(static, 1)
+        for (int t = 0; t < nthreads; t++) {
+            size_t begin = n * t / nthreads, end = n * (t + 1) / nthreads;
+            size_t *c = &count[t * nbuckets];
+            std::mt19937 gen(seed + t);
+            for (size_t i = begin; i < end; i++)
+                c[gen() & mask]++;
+        }
+#pragma omp single
+        {
+            // bucket-major offsets, so the buckets are contiguous
+            size_t sum = 0;
+            for (size_t b = 0; b < nbuckets; b++)
+                rep (u, nthreads) {
+                    size_t x = count[u * nbuckets + b];
+                    count[u * nbuckets + b] = sum;
+                    sum += x;
+                }
+        }
+#pragma omp for schedule(static, 1)
+        for (int t = 0; t < nthreads; t++) {
+            size_t begin = n * t / nthreads, end = n * (t + 1) / nthreads;
+            size_t *c = &count[t * nbuckets];
+            std::mt19937 gen(seed + t);
+            for (size_t i = begin; i < end; i++)
+                out[c[gen() & mask]++] = in[i];
+        }
+        // count now holds the end of every (slice, bucket) range
+        const size_t *ends = &count[(nthreads - 1) * nbuckets];
+#pragma omp for schedule(dynamic)
+        for (size_t b = 0; b < nbuckets; b++) {
+            std::mt19937 bgen(seed + nthreads + b);
+            std::shuffle(out + (b == 0 ? 0 : ends[b - 1]), out + ends[b], bgen);
+        }
+    }
+}
+
+} // namespace
+
+template <typename vid_t>
+void Shuffler<vid_t>::init()
+{
+    manifest().invalidate();
+    if (FLAGS_relabel == "parallel")
+        Converter<vid_t>::init();
     num_vertices = 0;
     num_edges = 0;
     nchunks = 0;
     degrees.reserve(1<<20);
-    pool.setWorkerCount(2, threadpool11::Pool::Method::SYNC);
+    pool.setWorkerCount(FLAGS_shuffle_threads > 0 ? FLAGS_shuffle_threads
+                                                  : omp_get_max_threads(),
+                        threadpool11::Pool::Method::SYNC);
     chunk_bufsize =
         FLAGS_memsize * 1024 * 1024 / pool.getWorkerCount() / sizeof(edge_t);
     chunk_buf.reserve(chunk_bufsize);
 }
 
-void Shuffler::finalize()
+template <typename vid_t>
+void Shuffler<vid_t>::finalize()
 {
-    cwrite(edge_t(0, 0), true);
-    pool.waitAll();
+    if (FLAGS_relabel == "parallel")
+        // the raw edges went to the binedgelist, which is relabeled and then
+        // shuffled, in memory if it fits or else through chunks
+        finish();
+    bool inmem = FLAGS_relabel == "parallel"
+                     ? num_edges * sizeof(edge_t) <= FLAGS_memsize * 1024 * 1024
+                     : nchunks == 0; // every edge is still in chunk_buf
     LOG(INFO) << "num_vertices: " << num_vertices
               << ", num_edges: " << num_edges;
-    LOG(INFO) << "number of chunks: " << nchunks;
 
-    std::vector<std::ifstream> fin(nchunks);
-    rep (i, nchunks) {
-        fin[i].open(chunk_filename(i), std::ios::binary);
-        CHECK(fin[i]) << "open chunk " << i << " failed";
-    }
-    std::vector<bool> finished(nchunks, false);
-    std::ofstream fout(shuffled_binedgelist_name(basefilename), std::ios::binary);
-    int count = 0;
-    fout.write((char *)&num_vertices, sizeof(num_vertices));
-    fout.write((char *)&num_edges, sizeof(num_edges));
-    while (true) {
-        int i = rand() % nchunks;
-        if (!fin[i].eof()) {
-            edge_t e;
-            fin[i].read((char *)&e, sizeof(edge_t));
-            if (fin[i].eof()) {
-                finished[i] = true;
-                count++;
-                if (count == nchunks)
-                    break;
-            } else
-                fout.write((char *)&e, sizeof(edge_t));
+    Timer merge_timer;
+    merge_timer.start();
+    if (inmem) {
+        LOG(INFO) << "shuffling in memory";
+        if (FLAGS_relabel == "parallel") {
+            std::string name = binedgelist_name(basefilename);
+            size_t header = sizeof(vid_t) + sizeof(size_t);
+            size_t filesize = header + num_edges * sizeof(edge_t);
+            int fd = open(name.c_str(), O_RDONLY);
+            PCHECK(fd != -1) << "Error opening `" << name << "' for read";
+            char *map =
+                (char *)mmap(0, filesize, PROT_READ, MAP_PRIVATE, fd, 0);
+            if (map == MAP_FAILED) {
+                close(fd);
+                PLOG(FATAL) << "error mapping the file";
+            }
+            madvise(map, filesize, MADV_SEQUENTIAL);
+            shuffle_in_memory((edge_t *)(map + header));
+            munmap(map, filesize);
+            close(fd);
+        } else {
+            shuffle_in_memory(chunk_buf.data());
+            std::vector<edge_t>().swap(chunk_buf);
         }
+    } else {
+        if (FLAGS_relabel == "parallel") {
+            std::ifstream fin(binedgelist_name(basefilename),
+                              std::ios::binary);
+            fin.seekg(sizeof(vid_t) + sizeof(size_t));
+            for (size_t i = 0; i < num_edges; i += chunk_bufsize) {
+                chunk_buf.resize(std::min(chunk_bufsize, num_edges - i));
+                fin.read((char *)&chunk_buf[0],
+                         chunk_buf.size() * sizeof(edge_t));
+                cwrite(edge_t(0, 0), true);
+                if (nchunks % pool.getWorkerCount() == 0)
+                    pool.waitAll();
+            }
+        }
+        if (!chunk_buf.empty() || nchunks == 0)
+            cwrite(edge_t(0, 0), true);
+        pool.waitAll();
+        LOG(INFO) << "number of chunks: " << nchunks;
+        merge_chunks();
+        chunk_clean();
     }
-    rep (i, nchunks)
-        fin[i].close();
-    fout.close();
-    chunk_clean();
+    merge_timer.stop();
+    LOG(INFO) << "merge time: " << merge_timer.get_time();
 
-    fout.open(degree_name(basefilename), std::ios::binary);
-    fout.write((char *)&degrees[0], num_vertices * sizeof(vid_t));
-    fout.close();
+    if (FLAGS_relabel != "parallel") {
+        fout.open(degree_name(basefilename));
+        fout.write((char *)&degrees[0], num_vertices * sizeof(vid_t));
+        fout.close();
+    }
+
+    if (FLAGS_compress) {
+        if (FLAGS_relabel == "parallel")
+            compress_edgelist<vid_t>(binedgelist_name(basefilename),
+                                     cbinedgelist_name(basefilename));
+        compress_edgelist<vid_t>(shuffled_binedgelist_name(basefilename),
+                                 shuffled_cbinedgelist_name(basefilename));
+    }
+    // the parallel mode leaves a complete edge list of the converter as well
+    if (FLAGS_relabel == "parallel")
+        Converter<vid_t>::manifest().commit();
+    manifest().commit();
 
     LOG(INFO) << "finished shuffle";
 }
 
-void Shuffler::add_edge(vid_t from, vid_t to)
+template <typename vid_t>
+void Shuffler<vid_t>::add_edge(vid_t from, vid_t to)
 {
     if (to == from) {
         LOG(WARNING) << "Tried to add self-edge " << from << "->" << to
                   << std::endl;
         return;
     }
+    if (FLAGS_relabel == "parallel") {
+        add_raw_edge(from, to);
+        return;
+    }
 
     num_edges++;
     from = get_vid(from);
@@ -82,20 +199,142 @@ void Shuffler::add_edge(vid_t from, vid_t to)
     cwrite(e);
 }
 
-std::string Shuffler::chunk_filename(int chunk)
+template <typename vid_t>
+void Shuffler<vid_t>::add_edges(const edge_t *edges, size_t n)
+{
+    for (size_t i = 0; i < n; i++) {
+        if (edges[i].first == edges[i].second)
+            continue;
+        if (FLAGS_relabel == "parallel") {
+            add_raw_edge(edges[i].first, edges[i].second);
+            continue;
+        }
+        num_edges++;
+        vid_t from = get_vid(edges[i].first), to = get_vid(edges[i].second);
+        degrees[from]++;
+        degrees[to]++;
+        cwrite(edge_t(from, to));
+    }
+}
+
+template <typename vid_t>
+void Shuffler<vid_t>::shuffle_in_memory(const edge_t *edges)
+{
+    std::vector<edge_t> shuffled(num_edges);
+    parallel_shuffle(edges, num_edges, shuffled.data(), 0);
+    fout.open(shuffled_binedgelist_name(basefilename));
+    fout.write((char *)&num_vertices, sizeof(num_vertices));
+    fout.write((char *)&num_edges, sizeof(num_edges));
+    fout.write((char *)shuffled.data(), num_edges * sizeof(edge_t));
+    fout.close();
+}
+
+template <typename vid_t>
+void Shuffler<vid_t>::merge_chunks()
+{
+    // Every round takes a block of edges from the chunks in proportion to
+    // their remaining edges, with random rounding, so the chunks drain
+    // evenly. The block is cut into one slice per thread, each slice taking
+    // the same share of every chunk, and the threads shuffle their slices
+    // with their own generators. As the chunks are shuffled already, this
+    // gives a random interleaving without touching the edges one by one.
+    int nthreads = omp_get_max_threads();
+    size_t block_edges = std::max((size_t)1 << 16, FLAGS_memsize * 1024 *
+                                                       1024 / 4 /
+                                                       sizeof(edge_t));
+    std::vector<int> fin(nchunks);
+    std::vector<size_t> remaining(nchunks), offset(nchunks, 0);
+    size_t total = 0;
+    rep (i, nchunks) {
+        fin[i] = open(chunk_filename(i).c_str(), O_RDONLY);
+        PCHECK(fin[i] != -1) << "open chunk " << i << " failed";
+        remaining[i] = file_size(chunk_filename(i)) / sizeof(edge_t);
+        total += remaining[i];
+    }
+    CHECK_EQ(total, num_edges) << "chunks do not add up to the edge list";
+
+    std::mt19937 gen;
+    std::uniform_real_distribution<double> rounding(0.0, 1.0);
+    std::vector<std::mt19937> gens(nthreads);
+    rep (t, nthreads)
+        gens[t].seed(gen());
+
+    fout.open(shuffled_binedgelist_name(basefilename));
+    fout.write((char *)&num_vertices, sizeof(num_vertices));
+    fout.write((char *)&num_edges, sizeof(num_edges));
+    std::vector<edge_t> block, out;
+    std::vector<size_t> count(nchunks), start(nchunks + 1),
+        slice(nthreads + 1);
+    while (total > 0) {
+        start[0] = 0;
+        rep (i, nchunks) {
+            count[i] = total <= block_edges
+                           ? remaining[i]
+                           : std::min(remaining[i],
+                                      (size_t)((double)block_edges *
+                                                   remaining[i] / total +
+                                               rounding(gen)));
+            start[i + 1] = start[i] + count[i];
+        }
+        size_t n = start[nchunks];
+        if (n == 0)
+            continue;
+        block.resize(n);
+        out.resize(n);
+
+#pragma omp parallel for schedule(dynamic)
+        for (int i = 0; i < nchunks; i++)
+            preada(fin[i], (char *)&block[start[i]], count[i] * sizeof(edge_t),
+                   offset[i] * sizeof(edge_t));
+
+        slice[0] = 0;
+        rep (t, nthreads) {
+            slice[t + 1] = slice[t];
+            rep (i, nchunks)
+                slice[t + 1] += count[i] * (t + 1) / nthreads -
+                                count[i] * t / nthreads;
+        }
+#pragma omp parallel for schedule(static, 1)
+        for (int t = 0; t < nthreads; t++) {
+            edge_t *dst = &out[0] + slice[t];
+            rep (i, nchunks) {
+                size_t first = count[i] * t / nthreads,
+                       last = count[i] * (t + 1) / nthreads;
+                dst = std::copy(&block[0] + start[i] + first,
+                                &block[0] + start[i] + last, dst);
+            }
+            std::shuffle(&out[0] + slice[t], &out[0] + slice[t + 1], gens[t]);
+        }
+        fout.write((char *)&out[0], n * sizeof(edge_t));
+
+        rep (i, nchunks) {
+            offset[i] += count[i];
+            remaining[i] -= count[i];
+        }
+        total -= n;
+    }
+    fout.close();
+    rep (i, nchunks)
+        close(fin[i]);
+}
+
+template <typename vid_t>
+std::string Shuffler<vid_t>::chunk_filename(int chunk)
 {
     std::stringstream ss;
     ss << basefilename << "." << chunk << ".chunk";
     return ss.str();
 }
 
-void Shuffler::chunk_clean()
+template <typename vid_t>
+void Shuffler<vid_t>::chunk_clean()
 {
     rep (i, nchunks)
         remove(chunk_filename(i).c_str());
 }
 
-void Shuffler::cwrite(edge_t e, bool flush)
+template <typename vid_t>
+void Shuffler<vid_t>::cwrite(edge_t e, bool flush)
 {
     if (!flush)
         chunk_buf.push_back(e);
@@ -108,3 +347,6 @@ void Shuffler::cwrite(edge_t e, bool flush)
         nchunks++;
     }
 }
+
+template class Shuffler<uint32_t>;
+template class Shuffler<uint64_t>;
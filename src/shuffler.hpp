@@ -1,6 +1,7 @@
 #pragma once
 
 #include <string>
+#include <random>
 
 #include <sys/types.h>
 #include <sys/stat.h>
@@ -9,19 +10,33 @@
 #include "util.hpp"
 #include "conversions.hpp"
 
-class Shuffler : public Converter
+DECLARE_int32(shuffle_threads);
+
+template <typename vid_t>
+class Shuffler : public Converter<vid_t>
 {
   private:
+    typedef basic_edge_t<vid_t> edge_t;
+    using Converter<vid_t>::basefilename;
+    using Converter<vid_t>::num_vertices;
+    using Converter<vid_t>::num_edges;
+    using Converter<vid_t>::degrees;
+    using Converter<vid_t>::fout;
+    using Converter<vid_t>::get_vid;
+    using Converter<vid_t>::add_raw_edge;
+    using Converter<vid_t>::finish;
+
     struct work_t {
         Shuffler *shuffler;
         int nchunks;
         std::vector<edge_t> chunk_buf;
 
         void operator()() {
-            std::random_shuffle(chunk_buf.begin(), chunk_buf.end());
-            int file =
-                open(shuffler->chunk_filename(nchunks).c_str(),
-                     O_WRONLY | O_CREAT, S_IROTH | S_IWOTH | S_IWUSR | S_IRUSR);
+            std::mt19937 gen(nchunks);
+            std::shuffle(chunk_buf.begin(), chunk_buf.end(), gen);
+            int file = open(shuffler->chunk_filename(nchunks).c_str(),
+                            O_WRONLY | O_CREAT | O_TRUNC,
+                            S_IROTH | S_IWOTH | S_IWUSR | S_IRUSR);
             size_t chunk_size = chunk_buf.size() * sizeof(edge_t);
             writea(file, (char *)&chunk_buf[0], chunk_size);
             close(file);
@@ -35,12 +50,26 @@ class Shuffler : public Converter
 
     std::string chunk_filename(int chunk);
     void chunk_clean();
+    void merge_chunks();
+    void shuffle_in_memory(const edge_t *edges);
     void cwrite(edge_t e, bool flush = false);
 
+    cache_manifest manifest()
+    {
+        cache_manifest m(shuffled_manifest_name(basefilename), basefilename);
+        m.set("filetype", FLAGS_filetype);
+        m.set("vid_size", sizeof(vid_t));
+        m.set("compress", FLAGS_compress);
+        m.add_output(FLAGS_compress ? shuffled_cbinedgelist_name(basefilename)
+                                    : shuffled_binedgelist_name(basefilename));
+        m.add_output(degree_name(basefilename));
+        return m;
+    }
+
   public:
-    Shuffler(std::string basefilename) : Converter(basefilename) {}
-    bool done() { return is_exists(shuffled_binedgelist_name(basefilename)); }
+    Shuffler(std::string basefilename) : Converter<vid_t>(basefilename) {}
     void init();
     void finalize();
     void add_edge(vid_t source, vid_t target);
+    void add_edges(const edge_t *edges, size_t n);
 };
@@ -2,43 +2,27 @@
 #include "conversions.hpp"
 #include "shuffler.hpp"
 
-SnePartitioner::SnePartitioner(std::string basefilename)
-    : basefilename(basefilename), rd(), gen(rd()), writer(basefilename)
+template <typename vid_t, typename heap_t>
+SnePartitioner<vid_t, heap_t>::SnePartitioner(std::string basefilename)
+    : basefilename(basefilename), rd(), gen(rd()),
+      writer(new_edgepart_writer<vid_t, uint16_t>(basefilename, FLAGS_p))
 {
     Timer shuffle_timer;
     shuffle_timer.start();
-    convert(basefilename, new Shuffler(basefilename));
+    convert(basefilename, new Shuffler<vid_t>(basefilename));
     shuffle_timer.stop();
     LOG(INFO) << "shuffle time: " << shuffle_timer.get_time();
 
     total_time.start();
     LOG(INFO) << "initializing partitioner";
 
-    fin = open(shuffled_binedgelist_name(basefilename).c_str(), O_RDONLY, (mode_t)0600);
-    PCHECK(fin != -1) << "Error opening file for read";
-    struct stat fileInfo = {0};
-    PCHECK(fstat(fin, &fileInfo) != -1) << "Error getting the file size";
-    PCHECK(fileInfo.st_size != 0) << "Error: file is empty";
-    LOG(INFO) << "file size: " << fileInfo.st_size;
-
-    fin_map = (char *)mmap(0, fileInfo.st_size, PROT_READ, MAP_SHARED, fin, 0);
-    if (fin_map == MAP_FAILED) {
-        close(fin);
-        PLOG(FATAL) << "error mapping the file";
-    }
-
-    filesize = fileInfo.st_size;
-    fin_ptr = fin_map;
-    fin_end = fin_map + filesize;
-
-    num_vertices = *(vid_t *)fin_ptr;
-    fin_ptr += sizeof(vid_t);
-    num_edges = *(size_t *)fin_ptr;
-    fin_ptr += sizeof(size_t);
+    stream.open(FLAGS_compress ? shuffled_cbinedgelist_name(basefilename)
+                               : shuffled_binedgelist_name(basefilename));
+    num_vertices = stream.num_vertices();
+    num_edges = stream.num_edges();
 
     LOG(INFO) << "num_vertices: " << num_vertices
               << ", num_edges: " << num_edges;
-    CHECK_EQ(sizeof(vid_t) + sizeof(size_t) + num_edges * sizeof(edge_t), filesize);
 
     p = FLAGS_p;
     average_degree = (double)num_edges * 2 / num_vertices;
@@ -55,12 +39,9 @@ SnePartitioner::SnePartitioner(std::string basefilename)
                            std::max((size_t)1, (size_t)(num_edges * 0.05 / p + 1)));
     LOG(INFO) << "buffer size: " << BUFFER_SIZE;
     occupied.assign(p, 0);
-    adj_out.resize(num_vertices);
-    adj_in.resize(num_vertices);
-    is_cores.assign(p, dense_bitset(num_vertices));
-    is_boundarys.assign(p, dense_bitset(num_vertices));
-    master.assign(num_vertices, -1);
-    dis.param(std::uniform_int_distribution<vid_t>::param_type(0, num_vertices - 1));
+    adj.resize(num_vertices);
+    members.resize(num_vertices, p);
+    current.resize(num_vertices);
 
     degrees.resize(num_vertices);
     std::ifstream degree_file(degree_name(basefilename), std::ios::binary);
@@ -68,83 +49,79 @@ SnePartitioner::SnePartitioner(std::string basefilename)
     degree_file.close();
 };
 
-void SnePartitioner::read_more()
+template <typename vid_t, typename heap_t>
+void SnePartitioner<vid_t, heap_t>::read_more()
 {
-    while (sample_edges.size() < max_sample_size && fin_ptr < fin_end) {
-        edge_t *fin_buffer_end = std::min((edge_t *)fin_ptr + BUFFER_SIZE, (edge_t *)fin_end);
-        size_t n = fin_buffer_end - (edge_t *)fin_ptr;
+    const edge_t *edges;
+    size_t n;
+    while (sample_edges.size() < max_sample_size &&
+           (n = stream.next(edges, BUFFER_SIZE))) {
         results.resize(n);
 
 #pragma omp parallel for
         for (size_t i = 0; i < n; i++)
-            results[i] = check_edge((edge_t *)fin_ptr + i);
+            results[i] = check_edge(edges + i);
 
         for (size_t i = 0; i < n; i++) {
-            edge_t *e = (edge_t *)fin_ptr + i;
+            const edge_t *e = edges + i;
             if (results[i] == p)
                 sample_edges.push_back(*e);
             else
-                assign_edge(results[i], e->first, e->second);
+                assign_checked(results[i], e->first, e->second);
         }
-        fin_ptr = (char *)fin_buffer_end;
     }
 
-    adj_out.build(sample_edges);
-
-    adj_in.build_reverse(sample_edges);
+    adj.build(sample_edges);
+    removed_edges.resize(sample_edges.size());
+    removed_edges.clear();
 }
 
-void SnePartitioner::read_remaining()
+template <typename vid_t, typename heap_t>
+void SnePartitioner<vid_t, heap_t>::read_remaining()
 {
-    auto &is_boundary = is_boundarys[p - 1], &is_core = is_cores[p - 1];
-
     for (auto &e : sample_edges)
         if (e.valid()) {
-            is_boundary.set_bit_unsync(e.first);
-            is_boundary.set_bit_unsync(e.second);
+            current.set_boundary(e.first);
+            current.set_boundary(e.second);
             assign_edge(p - 1, e.first, e.second);
         }
 
-    while (fin_ptr < fin_end) {
-        edge_t *fin_buffer_end = std::min((edge_t *)fin_ptr + BUFFER_SIZE, (edge_t *)fin_end);
-        size_t n = fin_buffer_end - (edge_t *)fin_ptr;
+    const edge_t *edges;
+    size_t n;
+    while ((n = stream.next(edges, BUFFER_SIZE))) {
         results.resize(n);
 
 #pragma omp parallel for
         for (size_t i = 0; i < n; i++)
-            results[i] = check_edge((edge_t *)fin_ptr + i);
+            results[i] = check_edge(edges + i);
 
         for (size_t i = 0; i < n; i++) {
-            edge_t *e = (edge_t *)fin_ptr + i;
+            const edge_t *e = edges + i;
             if (results[i] == p) {
-                is_boundary.set_bit_unsync(e->first);
-                is_boundary.set_bit_unsync(e->second);
+                current.set_boundary(e->first);
+                current.set_boundary(e->second);
                 assign_edge(p - 1, e->first, e->second);
             } else
-                assign_edge(results[i], e->first, e->second);
+                assign_checked(results[i], e->first, e->second);
         }
-        fin_ptr = (char *)fin_buffer_end;
     }
 
-    repv (i, num_vertices) {
-        if (is_boundary.get(i)) {
-            is_core.set_bit_unsync(i);
-            rep (j, p - 1)
-                if (is_cores[j].get(i)) {
-                    is_core.set_unsync(i, false);
-                    break;
-                }
-        }
-    }
+    current.finish_last(members, p - 1);
 }
 
-void SnePartitioner::clean_samples()
+template <typename vid_t, typename heap_t>
+void SnePartitioner<vid_t, heap_t>::clean_samples()
 {
+    // the expansion removed edges from the graph only
+    for (size_t i = 0; i < sample_edges.size(); i++)
+        if (removed_edges.get(i))
+            sample_edges[i].remove();
     for (size_t i = 0; i < sample_edges.size();) {
         if (sample_edges[i].valid()) {
             int bucket = check_edge(&sample_edges[i]);
             if (bucket < p) {
-                assign_edge(bucket, sample_edges[i].first, sample_edges[i].second);
+                assign_checked(bucket, sample_edges[i].first,
+                               sample_edges[i].second);
                 std::swap(sample_edges[i], sample_edges.back());
                 sample_edges.pop_back();
             } else
@@ -156,50 +133,14 @@ void SnePartitioner::clean_samples()
     }
 }
 
-void SnePartitioner::assign_master()
+template <typename vid_t, typename heap_t>
+size_t SnePartitioner<vid_t, heap_t>::count_mirrors()
 {
-    std::vector<vid_t> count_master(p, 0);
-    std::vector<vid_t> quota(p, num_vertices);
-    long long sum = p * num_vertices;
-    std::uniform_real_distribution<double> distribution(0.0, 1.0);
-    std::vector<dense_bitset::iterator> pos(p);
-    rep (b, p)
-        pos[b] = is_boundarys[b].begin();
-    vid_t count = 0;
-    while (count < num_vertices) {
-        long long r = distribution(gen) * sum;
-        int k;
-        for (k = 0; k < p; k++) {
-            if (r < quota[k])
-                break;
-            r -= quota[k];
-        }
-        while (pos[k] != is_boundarys[k].end() && master[*pos[k]] != -1)
-            pos[k]++;
-        if (pos[k] != is_boundarys[k].end()) {
-            count++;
-            master[*pos[k]] = k;
-            writer.save_vertex(*pos[k], k);
-            count_master[k]++;
-            quota[k]--;
-            sum--;
-        }
-    }
-    int max_masters =
-        *std::max_element(count_master.begin(), count_master.end());
-    LOG(INFO) << "master balance: "
-              << (double)max_masters / ((double)num_vertices / p);
+    return members.count(MEMBER_BOUNDARY);
 }
 
-size_t SnePartitioner::count_mirrors()
-{
-    size_t result = 0;
-    rep (i, p)
-        result += is_boundarys[i].popcount();
-    return result;
-}
-
-void SnePartitioner::split()
+template <typename vid_t, typename heap_t>
+void SnePartitioner<vid_t, heap_t>::split()
 {
     LOG(INFO) << "partition `" << basefilename << "'";
     LOG(INFO) << "number of partitions: " << p;
@@ -214,10 +155,11 @@ void SnePartitioner::split()
         read_timer.start();
         read_more();
         read_timer.stop();
-        DLOG(INFO) << "sample size: " << adj_out.num_edges();
+        DLOG(INFO) << "sample size: " << adj.num_edges();
         compute_timer.start();
+        seeds.build(adj, num_vertices, 2 * local_average_degree);
         local_capacity =
-            FLAGS_inmem ? capacity : adj_out.num_edges() / (p - bucket);
+            FLAGS_inmem ? capacity : adj.num_edges() / (p - bucket);
         while (occupied[bucket] < local_capacity) {
             vid_t d, vid;
             if (!min_heap.get_min(d, vid)) {
@@ -226,16 +168,17 @@ void SnePartitioner::split()
                                << " stop: no free vertices";
                     break;
                 }
-                d = adj_out[vid].size() + adj_in[vid].size();
+                d = adj[vid].size();
             } else {
                 min_heap.remove(vid);
-                /* CHECK_EQ(d, adj_out[vid].size() + adj_in[vid].size()); */
+                /* CHECK_EQ(d, adj[vid].size()); */
             }
 
             occupy_vertex(vid, d);
         }
         min_heap.clear();
         clean_samples();
+        current.finish(members, bucket);
         compute_timer.stop();
         LOG(INFO) << "finished part: " << bucket;
     }
@@ -259,16 +202,21 @@ void SnePartitioner::split()
     LOG(INFO) << "time used for partitioning: " << compute_timer.get_time();
 
     LOG(INFO) << "delayed master assignment: ";
-    assign_master();
+    std::vector<uint16_t> master;
+    assign_master(members, num_vertices, gen, *writer, master);
+    if (FLAGS_output_replicas)
+        save_replica_map<vid_t>(replicas_name(basefilename), members, master);
+    writer->close();
 
-    if (munmap(fin_map, filesize) == -1) {
-        close(fin);
-        PLOG(FATAL) << "Error un-mmapping the file";
-    }
-    close(fin);
+    stream.close();
 
     CHECK_EQ(assigned_edges, num_edges);
 
     total_time.stop();
     LOG(INFO) << "total partition time: " << total_time.get_time();
 }
+
+template class SnePartitioner<uint32_t>;
+template class SnePartitioner<uint64_t>;
+template class SnePartitioner<uint32_t, BucketQueue<uint32_t, uint32_t>>;
+template class SnePartitioner<uint64_t, BucketQueue<uint64_t, uint64_t>>;
@@ -5,22 +5,25 @@
 #include <iostream>
 #include <fstream>
 #include <random>
-#include <fcntl.h>
-#include <sys/stat.h>
-#include <sys/mman.h>
-#include <unistd.h>
+#include <memory>
 
 #include "util.hpp"
 #include "min_heap.hpp"
+#include "bucket_queue.hpp"
 #include "dense_bitset.hpp"
 #include "edgepart.hpp"
 #include "partitioner.hpp"
 #include "graph.hpp"
+#include "seed_index.hpp"
+#include "edge_stream.hpp"
 
 /* Streaming Neighbor Expansion (SNE) */
+template <typename vid_t, typename heap_t = MinHeap<vid_t, vid_t>>
 class SnePartitioner : public Partitioner
 {
   private:
+    typedef basic_edge_t<vid_t> edge_t;
+
     const double BALANCE_RATIO = 1.05;
     size_t BUFFER_SIZE;
 
@@ -33,57 +36,76 @@ class SnePartitioner : public Partitioner
     size_t max_sample_size;
     size_t capacity, local_capacity;
 
-    // use mmap for file input
-    int fin;
-    off_t filesize;
-    char *fin_map, *fin_ptr, *fin_end;
+    edge_stream<vid_t> stream;
 
     std::vector<edge_t> buffer;
     std::vector<edge_t> sample_edges;
-    graph_t adj_out, adj_in;
-    MinHeap<vid_t, vid_t> min_heap;
+    graph_t<vid_t> adj;
+    dense_bitset removed_edges; // of sample_edges, by index
+    heap_t min_heap;
     std::vector<size_t> occupied;
     std::vector<vid_t> degrees;
-    std::vector<int8_t> master;
-    std::vector<dense_bitset> is_cores, is_boundarys;
-    std::vector<int8_t> results;
+    membership members;             // of the partitions grown so far
+    dense_partition<vid_t> current; // of the partition being grown
+    std::vector<uint16_t> results;
 
     std::random_device rd;
     std::mt19937 gen;
-    std::uniform_int_distribution<vid_t> dis;
+    seed_index<vid_t> seeds; // of the sample
 
-    edgepart_writer<vid_t, uint16_t> writer;
+    std::unique_ptr<edgepart_writer<vid_t, uint16_t>> writer;
 
+    /*
+     * Picks a partition grown so far for e: the first one holding both ends
+     * as replicas, else the first one holding an end as a core, unless the
+     * other end is of high degree; p if none has room. Only reads the
+     * membership, so that it can run on a batch of edges in parallel; the
+     * ends become replicas of the partition in assign_checked.
+     */
     int check_edge(const edge_t *e)
     {
-        rep (i, bucket) {
-            auto &is_boundary = is_boundarys[i];
-            if (is_boundary.get(e->first) && is_boundary.get(e->second) &&
-                occupied[i] < capacity) {
-                return i;
-            }
+        const uint16_t *a = members.entries(e->first),
+                       *b = members.entries(e->second);
+        size_t na = members.size(e->first), nb = members.size(e->second);
+
+        for (size_t i = 0, j = 0; i < na && j < nb;) {
+            int pa = a[i] & MEMBER_PARTITION, pb = b[j] & MEMBER_PARTITION;
+            if (pa < pb)
+                i++;
+            else if (pb < pa)
+                j++;
+            else if ((a[i++] & b[j++] & MEMBER_BOUNDARY) &&
+                     occupied[pa] < capacity)
+                return pa;
         }
 
-        rep (i, bucket) {
-            auto &is_core = is_cores[i], &is_boundary = is_boundarys[i];
-            if ((is_core.get(e->first) || is_core.get(e->second)) &&
-                occupied[i] < capacity) {
-                if (is_core.get(e->first) && degrees[e->second] > average_degree)
+        for (size_t i = 0, j = 0; i < na || j < nb;) {
+            int pa = i < na ? a[i] & MEMBER_PARTITION : p,
+                pb = j < nb ? b[j] & MEMBER_PARTITION : p, k = std::min(pa, pb);
+            bool first_core = pa == k && (a[i++] & MEMBER_CORE);
+            bool second_core = pb == k && (b[j++] & MEMBER_CORE);
+            if ((first_core || second_core) && occupied[k] < capacity) {
+                if (first_core && degrees[e->second] > average_degree)
                     continue;
-                if (is_core.get(e->second) && degrees[e->first] > average_degree)
+                if (second_core && degrees[e->first] > average_degree)
                     continue;
-                is_boundary.set_bit(e->first);
-                is_boundary.set_bit(e->second);
-                return i;
+                return k;
             }
         }
 
         return p;
     }
 
+    void assign_checked(int bucket, vid_t from, vid_t to)
+    {
+        members.add(from, bucket, MEMBER_BOUNDARY);
+        members.add(to, bucket, MEMBER_BOUNDARY);
+        assign_edge(bucket, from, to);
+    }
+
     void assign_edge(int bucket, vid_t from, vid_t to)
     {
-        writer.save_edge(from, to, bucket);
+        writer->save_edge(from, to, bucket);
         assigned_edges++;
         occupied[bucket]++;
         degrees[from]--;
@@ -92,88 +114,68 @@ class SnePartitioner : public Partitioner
 
     void add_boundary(vid_t vid)
     {
-        auto &is_core = is_cores[bucket], &is_boundary = is_boundarys[bucket];
+        auto &is_core = current.is_core, &is_boundary = current.is_boundary;
 
         if (is_boundary.get(vid))
             return;
-        is_boundary.set_bit_unsync(vid);
+        current.set_boundary(vid);
 
         if (!is_core.get(vid)) {
-            min_heap.insert(adj_out[vid].size() + adj_in[vid].size(), vid);
+            min_heap.insert(adj[vid].size(), vid);
         }
 
-        rep (direction, 2) {
-            adjlist_t &neighbors = direction ? adj_out[vid] : adj_in[vid];
-            for (size_t i = 0; i < neighbors.size();) {
-                if (sample_edges[neighbors[i].v].valid()) {
-                    vid_t &u = direction ? sample_edges[neighbors[i].v].second : sample_edges[neighbors[i].v].first;
-                    if (is_core.get(u)) {
-                        assign_edge(bucket, direction ? vid : u,
-                                    direction ? u : vid);
-                        min_heap.decrease_key(vid);
-                        sample_edges[neighbors[i].v].remove();
-                        std::swap(neighbors[i], neighbors.back());
-                        neighbors.pop_back();
-                    } else if (is_boundary.get(u) &&
-                               occupied[bucket] < capacity) {
-                        assign_edge(bucket, direction ? vid : u,
-                                    direction ? u : vid);
-                        min_heap.decrease_key(vid);
-                        min_heap.decrease_key(u);
-                        sample_edges[neighbors[i].v].remove();
-                        std::swap(neighbors[i], neighbors.back());
-                        neighbors.pop_back();
-                    } else
-                        i++;
-                } else {
+        adjlist_t<vid_t> neighbors = adj[vid];
+        for (size_t i = 0; i < neighbors.size();) {
+            if (!removed_edges.get(neighbors[i].e)) {
+                vid_t u = neighbors[i].v;
+                bool out = neighbors[i].out;
+                if (is_core.get(u)) {
+                    assign_edge(bucket, out ? vid : u, out ? u : vid);
+                    min_heap.decrease_key(vid);
+                    removed_edges.set_bit_unsync(neighbors[i].e);
                     std::swap(neighbors[i], neighbors.back());
                     neighbors.pop_back();
-                }
+                } else if (is_boundary.get(u) &&
+                           occupied[bucket] < capacity) {
+                    assign_edge(bucket, out ? vid : u, out ? u : vid);
+                    min_heap.decrease_key(vid);
+                    min_heap.decrease_key(u);
+                    removed_edges.set_bit_unsync(neighbors[i].e);
+                    std::swap(neighbors[i], neighbors.back());
+                    neighbors.pop_back();
+                } else
+                    i++;
+            } else {
+                std::swap(neighbors[i], neighbors.back());
+                neighbors.pop_back();
             }
         }
     }
 
     void occupy_vertex(vid_t vid, vid_t d)
     {
-        CHECK(!is_cores[bucket].get(vid)) << "add " << vid << " to core again";
-        is_cores[bucket].set_bit_unsync(vid);
+        CHECK(!current.is_core.get(vid)) << "add " << vid << " to core again";
+        current.set_core(vid);
 
         if (d == 0)
             return;
 
         add_boundary(vid);
 
-        for (auto &i : adj_out[vid])
-            if (sample_edges[i.v].valid())
-                add_boundary(sample_edges[i.v].second);
-        adj_out[vid].clear();
-
-        for (auto &i : adj_in[vid])
-            if (sample_edges[i.v].valid())
-                add_boundary(sample_edges[i.v].first);
-        adj_in[vid].clear();
+        for (auto &i : adj[vid])
+            if (!removed_edges.get(i.e))
+                add_boundary(i.v);
+        adj[vid].clear();
     }
 
     bool get_free_vertex(vid_t &vid)
     {
-        vid = dis(gen);
-        vid_t count = 0;
-        while (count < num_vertices &&
-               (adj_out[vid].size() + adj_in[vid].size() == 0 ||
-                adj_out[vid].size() + adj_in[vid].size() >
-                    2 * local_average_degree ||
-                is_cores[bucket].get(vid))) {
-            vid = (vid + ++count) % num_vertices;
-        }
-        if (count == num_vertices)
-            return false;
-        return true;
+        return seeds.pick(gen, current.is_core, vid);
     }
 
     void read_more();
     void read_remaining();
     void clean_samples();
-    void assign_master();
     size_t count_mirrors();
 
   public:
@@ -0,0 +1,155 @@
+#include <algorithm>
+#include <fcntl.h>
+#include <unistd.h>
+#include <omp.h>
+
+#include "subgraph.hpp"
+
+namespace
+{
+
+template <typename T>
+void write_array(block_writer &fout, const std::vector<T> &a)
+{
+    const char zeros[8] = {0};
+    if (!a.empty())
+        fout.write((const char *)&a[0], a.size() * sizeof(T));
+    fout.write(zeros, (8 - fout.tell() % 8) % 8);
+}
+
+/* Builds the CSR of the edges by source, or by target if reverse */
+template <typename vid_t>
+void build_csr(const std::vector<basic_edge_t<vid_t>> &edges, size_t n,
+               bool reverse, std::vector<uint64_t> &offsets,
+               std::vector<vid_t> &neighbors)
+{
+    offsets.assign(n + 1, 0);
+    for (auto &e : edges)
+        offsets[(reverse ? e.second : e.first) + 1]++;
+    for (size_t i = 0; i < n; i++)
+        offsets[i + 1] += offsets[i];
+    std::vector<uint64_t> pos(offsets.begin(), offsets.end() - 1);
+    neighbors.resize(edges.size());
+    for (auto &e : edges)
+        if (reverse)
+            neighbors[pos[e.second]++] = e.first;
+        else
+            neighbors[pos[e.first]++] = e.second;
+    for (size_t i = 0; i < n; i++)
+        std::sort(neighbors.begin() + offsets[i],
+                  neighbors.begin() + offsets[i + 1]);
+}
+
+} // namespace
+
+template <typename vid_t, typename proc_t>
+subgraph_writer<vid_t, proc_t>::subgraph_writer(
+    edgepart_writer<vid_t, proc_t> *writer, const std::string &basefilename,
+    int num_partitions, size_t block_size)
+    : writer(writer), basefilename(basefilename), spills(num_partitions)
+{
+    rep (i, num_partitions)
+        spills[i].reset(new block_writer(spill_name(i), block_size));
+}
+
+template <typename vid_t, typename proc_t>
+void subgraph_writer<vid_t, proc_t>::build(int i)
+{
+    std::string spill = spill_name(i);
+    std::vector<edge_t> edges(file_size(spill) / sizeof(edge_t));
+    int fd = open(spill.c_str(), O_RDONLY);
+    PCHECK(fd != -1) << "Error opening `" << spill << "' for read";
+    if (!edges.empty())
+        preada(fd, (char *)&edges[0], edges.size() * sizeof(edge_t), 0);
+    ::close(fd);
+    remove(spill.c_str());
+
+    // number the endpoints and the masters of the partition densely
+    std::vector<vid_t> global;
+    global.reserve(2 * edges.size());
+    for (auto &e : edges) {
+        global.push_back(e.first);
+        global.push_back(e.second);
+    }
+    global.insert(global.end(), mastered[i].begin(), mastered[i].end());
+    std::vector<vid_t>().swap(mastered[i]);
+    std::sort(global.begin(), global.end());
+    global.erase(std::unique(global.begin(), global.end()), global.end());
+    auto local = [&global](vid_t v) {
+        return (vid_t)(std::lower_bound(global.begin(), global.end(), v) -
+                       global.begin());
+    };
+    std::vector<uint16_t> masters(global.size());
+    for (size_t j = 0; j < global.size(); j++)
+        masters[j] = global[j] < master.size() ? master[global[j]] : -1;
+    for (auto &e : edges) {
+        e.first = local(e.first);
+        e.second = local(e.second);
+    }
+
+    subgraph_header header;
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, SUBGRAPH_MAGIC, sizeof(header.magic));
+    header.version = SUBGRAPH_VERSION;
+    header.flags = FLAGS_subgraph_in_edges ? SUBGRAPH_IN_EDGES : 0;
+    header.vid_size = sizeof(vid_t);
+    header.partition = i;
+    header.num_partitions = spills.size();
+    header.num_vertices = global.size();
+    header.num_edges = edges.size();
+
+    block_writer fout(subgraph_name(basefilename, i),
+                      FLAGS_write_blocksize * 1024 * 1024, false);
+    fout.write((const char *)&header, sizeof(header));
+    write_array(fout, global);
+    write_array(fout, masters);
+    std::vector<uint64_t> offsets;
+    std::vector<vid_t> neighbors;
+    rep (direction, FLAGS_subgraph_in_edges ? 2 : 1) {
+        build_csr(edges, global.size(), direction == 1, offsets, neighbors);
+        write_array(fout, offsets);
+        write_array(fout, neighbors);
+    }
+    fout.close();
+}
+
+template <typename vid_t, typename proc_t>
+void subgraph_writer<vid_t, proc_t>::close()
+{
+    writer->close();
+    for (auto &spill : spills)
+        spill->close();
+    mastered.resize(spills.size());
+    for (size_t v = 0; v < master.size(); v++)
+        if (master[v] < spills.size())
+            mastered[master[v]].push_back(v);
+
+    Timer timer;
+    timer.start();
+    // a partition per thread, each one as large as a worker has to load
+#pragma omp parallel for schedule(dynamic)
+    for (size_t i = 0; i < spills.size(); i++)
+        build(i);
+    timer.stop();
+    LOG(INFO) << "built " << spills.size() << " local subgraphs in "
+              << timer.get_time() << "s";
+}
+
+template <typename vid_t, typename proc_t>
+edgepart_writer<vid_t, proc_t> *
+new_subgraph_writer(edgepart_writer<vid_t, proc_t> *writer,
+                    const std::string &basefilename, int num_partitions,
+                    size_t block_size)
+{
+    return new subgraph_writer<vid_t, proc_t>(writer, basefilename,
+                                              num_partitions, block_size);
+}
+
+template class subgraph_writer<uint32_t, uint16_t>;
+template class subgraph_writer<uint64_t, uint16_t>;
+template edgepart_writer<uint32_t, uint16_t> *
+new_subgraph_writer(edgepart_writer<uint32_t, uint16_t> *, const std::string &,
+                    int, size_t);
+template edgepart_writer<uint64_t, uint16_t> *
+new_subgraph_writer(edgepart_writer<uint64_t, uint16_t> *, const std::string &,
+                    int, size_t);
@@ -0,0 +1,92 @@
+#pragma once
+
+#include <string>
+#include <vector>
+#include <memory>
+
+#include "util.hpp"
+#include "block_writer.hpp"
+#include "edgepart.hpp"
+
+DECLARE_bool(output_subgraphs);
+DECLARE_bool(subgraph_in_edges);
+
+/*
+ * Local subgraph of a partition (.subgraph.<p>.<i>), ready to be loaded by
+ * the worker of that partition without touching global ids:
+ *
+ *   header     subgraph_header
+ *   global     vid_t[num_vertices], the global id of every local vertex
+ *   master     uint16_t[num_vertices], the partition of its master
+ *   out        uint64_t[num_vertices + 1] offsets, vid_t[num_edges] targets
+ *   in         the same for the sources, if SUBGRAPH_IN_EDGES is set
+ *
+ * Every array starts 8-byte aligned. The local vertices are the endpoints
+ * of the edges of the partition and the vertices it is the master of,
+ * numbered densely in increasing order of global id; the neighbors of a
+ * vertex are sorted.
+ */
+const char SUBGRAPH_MAGIC[8] = {'S', 'U', 'B', 'G', 'R', 'A', 'P', 'H'};
+const uint32_t SUBGRAPH_VERSION = 1;
+const uint32_t SUBGRAPH_IN_EDGES = 1;
+
+struct subgraph_header {
+    char magic[8];
+    uint32_t version, flags;
+    uint32_t vid_size, partition, num_partitions, reserved;
+    uint64_t num_vertices, num_edges;
+};
+
+/*
+ * Passes everything on to writer and also spills the edges of every
+ * partition to a temporary file; at close, the subgraphs are built from
+ * these files, a partition per thread.
+ */
+template <typename vid_t, typename proc_t>
+class subgraph_writer : public edgepart_writer<vid_t, proc_t>
+{
+  private:
+    typedef basic_edge_t<vid_t> edge_t;
+
+    std::unique_ptr<edgepart_writer<vid_t, proc_t>> writer;
+    std::string basefilename;
+    std::vector<std::unique_ptr<block_writer>> spills;
+    std::vector<proc_t> master;
+    std::vector<std::vector<vid_t>> mastered; // by partition, at close
+
+    std::string spill_name(int i) const
+    {
+        return subgraph_name(basefilename, i) + ".tmp";
+    }
+
+    void build(int i);
+
+  public:
+    subgraph_writer(edgepart_writer<vid_t, proc_t> *writer,
+                    const std::string &basefilename, int num_partitions,
+                    size_t block_size);
+
+    void save_vertex(vid_t v, proc_t proc)
+    {
+        writer->save_vertex(v, proc);
+        if (v >= master.size())
+            master.resize(std::max((size_t)v + 1, 2 * master.size()), -1);
+        master[v] = proc;
+    }
+
+    void save_edge(vid_t from, vid_t to, proc_t proc)
+    {
+        writer->save_edge(from, to, proc);
+        edge_t e(from, to);
+        spills[proc]->write((const char *)&e, sizeof(edge_t));
+    }
+
+    void save_edges(const edge_t *edges, const proc_t *procs, size_t n)
+    {
+        writer->save_edges(edges, procs, n);
+        for (size_t i = 0; i < n; i++)
+            spills[procs[i]]->write((const char *)&edges[i], sizeof(edge_t));
+    }
+
+    void close();
+};
@@ -1,11 +1,34 @@
 #include <iterator>
 #include <algorithm>
 #include <functional>
+#include <omp.h>
 
 #include "util.hpp"
 
 threadpool11::Pool pool;
 
+void prefix_sum(std::vector<uint64_t> &offsets)
+{
+    size_t num_vertices = offsets.size() - 1;
+    // prefix sums of per-thread ranges, shifted by the preceding ranges
+    std::vector<uint64_t> partial(omp_get_max_threads() + 1, 0);
+#pragma omp parallel
+    {
+        int t = omp_get_thread_num(), nthreads = omp_get_num_threads();
+        size_t begin = num_vertices * t / nthreads + 1,
+               end = num_vertices * (t + 1) / nthreads + 1;
+        for (size_t i = begin + 1; i < end; i++)
+            offsets[i] += offsets[i - 1];
+        partial[t + 1] = end > begin ? offsets[end - 1] : 0;
+#pragma omp barrier
+#pragma omp single
+        rep (i, nthreads)
+            partial[i + 1] += partial[i];
+        for (size_t i = begin; i < end; i++)
+            offsets[i] += partial[t];
+    }
+}
+
 void preada(int f, char *buf, size_t nbytes, size_t off)
 {
     size_t nread = 0;
@@ -41,3 +64,15 @@ void writea(int f, char *buf, size_t nbytes)
         nwritten += a;
     }
 }
+
+void pwritea(int f, char *buf, size_t nbytes, size_t off)
+{
+    size_t nwritten = 0;
+    while (nwritten < nbytes) {
+        ssize_t a = pwrite(f, buf, nbytes - nwritten, off + nwritten);
+        PCHECK(a != ssize_t(-1)) << "Could not write " << (nbytes - nwritten)
+                                 << " bytes!";
+        buf += a;
+        nwritten += a;
+    }
+}
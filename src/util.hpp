@@ -1,6 +1,7 @@
 #pragma once
 
 #include <utility>
+#include <vector>
 #include <chrono>
 #include <stdint.h>
 #include <sys/stat.h>
@@ -20,12 +21,18 @@ DECLARE_string(filetype);
 DECLARE_bool(inmem);
 DECLARE_double(sample_ratio);
 
-typedef uint32_t vid_t;
-const vid_t INVALID_VID = -1;
-struct edge_t {
+/*
+ * Vertex ids are either uint32_t or uint64_t, chosen at runtime by -vid64.
+ * The code that handles ids is templated on the id type, which is always
+ * called vid_t, and instantiated for both widths; the 32-bit instantiation
+ * keeps the original layout of edges and files.
+ */
+template <typename vid_t>
+struct basic_edge_t {
+    static const vid_t INVALID_VID = (vid_t)-1;
     vid_t first, second;
-    edge_t() : first(0), second(0) {}
-    edge_t(vid_t first, vid_t second) : first(first), second(second) {}
+    basic_edge_t() : first(0), second(0) {}
+    basic_edge_t(vid_t first, vid_t second) : first(first), second(second) {}
     const bool valid() { return first != INVALID_VID; }
     void remove() { first = INVALID_VID; }
 };
@@ -35,6 +42,10 @@ extern threadpool11::Pool pool;
 void preada(int f, char *buf, size_t nbytes, size_t off);
 void reada(int f, char *buf, size_t nbytes);
 void writea(int f, char *buf, size_t nbytes);
+void pwritea(int f, char *buf, size_t nbytes, size_t off);
+
+/* Turns the counts in offsets[1..] into offsets, in parallel */
+void prefix_sum(std::vector<uint64_t> &offsets);
 
 inline std::string binedgelist_name(const std::string &basefilename)
 {
@@ -48,6 +59,30 @@ inline std::string shuffled_binedgelist_name(const std::string &basefilename)
     ss << basefilename << ".shuffled.binedgelist";
     return ss.str();
 }
+inline std::string cbinedgelist_name(const std::string &basefilename)
+{
+    std::stringstream ss;
+    ss << basefilename << ".cbinedgelist";
+    return ss.str();
+}
+inline std::string shuffled_cbinedgelist_name(const std::string &basefilename)
+{
+    std::stringstream ss;
+    ss << basefilename << ".shuffled.cbinedgelist";
+    return ss.str();
+}
+inline std::string manifest_name(const std::string &basefilename)
+{
+    std::stringstream ss;
+    ss << basefilename << ".manifest";
+    return ss.str();
+}
+inline std::string shuffled_manifest_name(const std::string &basefilename)
+{
+    std::stringstream ss;
+    ss << basefilename << ".shuffled.manifest";
+    return ss.str();
+}
 inline std::string degree_name(const std::string &basefilename)
 {
     std::stringstream ss;
@@ -62,6 +97,36 @@ inline std::string partitioned_name(const std::string &basefilename)
     return ss.str();
 }
 
+inline std::string replicas_name(const std::string &basefilename)
+{
+    std::stringstream ss;
+    ss << basefilename << ".replicas." << FLAGS_p;
+    return ss.str();
+}
+
+inline std::string subgraph_name(const std::string &basefilename, int i)
+{
+    std::stringstream ss;
+    ss << basefilename << ".subgraph." << FLAGS_p << "." << i;
+    return ss.str();
+}
+
+inline std::string scratch_name(const std::string &basefilename,
+                                const std::string &what)
+{
+    std::stringstream ss;
+    ss << basefilename << ".scratch." << what;
+    return ss.str();
+}
+
+inline std::string partitioned_shard_name(const std::string &basefilename,
+                                          int shard)
+{
+    std::stringstream ss;
+    ss << partitioned_name(basefilename) << "." << shard;
+    return ss.str();
+}
+
 inline std::string hilbert_name(const std::string &basefilename)
 {
     std::stringstream ss;
@@ -82,6 +147,12 @@ inline bool is_exists(const std::string &name)
     return (stat(name.c_str(), &buffer) == 0);
 }
 
+inline size_t file_size(const std::string &name)
+{
+    struct stat buffer;
+    return stat(name.c_str(), &buffer) == 0 ? buffer.st_size : 0;
+}
+
 class Timer
 {
   private: